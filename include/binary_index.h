@@ -0,0 +1,61 @@
+#pragma once
+#include "shared_rows.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <span>
+#include <vector>
+
+// One-bit sign codes beside the stored rows: bit d is set where the row
+// exceeds threshold[d], the mean of the rows the index was trained on. The
+// Hamming distance between codes tracks the angle between vectors, so a
+// popcount scan over every code (dim / 8 bytes a row, 1/32 of float32)
+// picks candidates that the store then rescores exactly.
+class BinaryIndex {
+public:
+    struct Params {
+        size_t candidates = 256;   // rows rescored per query (at least topK)
+    };
+
+    // Adds row `row` into a dense accumulator of length dim
+    using AccumulateRow = std::function<void(uint32_t row, std::span<float> sum)>;
+    using Accept = std::function<bool(uint32_t row)>;
+
+    BinaryIndex() = default;
+
+    const Params& params() const { return settings; }
+    void setParams(const Params& params) { settings = params; }
+
+    bool trained() const { return !thresholds.empty(); }
+    size_t dim() const { return thresholds.size(); }
+    // Rows encoded (kept in step with the store)
+    size_t size() const { return codes.size(); }
+    size_t rowBytes() const { return words * sizeof(uint64_t); }
+
+    // Learns the thresholds from rows [0, rows) and drops any codes
+    void train(size_t rows, size_t dim, const AccumulateRow& accumulate);
+    // Encodes the next row, or overwrites row i; values past dim() are ignored
+    void add(std::span<const float> row);
+    void setRow(size_t i, std::span<const float> row);
+    // Drops the codes but keeps the thresholds
+    void clearCodes();
+    void clear();
+
+    // Up to count accepted rows closest to the query in Hamming distance,
+    // in ascending row order; ties at the cut go to lower rows
+    std::vector<uint32_t> nearest(std::span<const float> query, size_t count,
+                                  const Accept& accept = Accept()) const;
+
+    static constexpr uint32_t FILE_MAGIC = 0x584E4942;  // "BINX"
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    Params settings;
+    std::vector<float> thresholds;
+    SharedRows<uint64_t> codes;    // words per row
+    size_t words = 0;
+
+    void encode(std::span<const float> row, uint64_t* out) const;
+};
@@ -1,3 +1,5 @@
+#include "../sparse_vector.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -9,5 +11,6 @@ struct CodeChunk {
     int startLine;
     int endLine;
     std::string code;
-    std::vector<float> embedding; // reserved for later
+    SparseVector embedding;
+    int64_t modifiedTime = 0;   // source file mtime, seconds since epoch
 };
@@ -29,6 +29,7 @@ public:
 
     void handleCommand(const std::string& input);
     void handleSimilarityCommand(const std::string& args);
+    void handleIndexCommand(const std::string& args);
 
     // NEW: Send query through Memory + RAG + LLM
     std::string processQuery(const std::string& input);
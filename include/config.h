@@ -12,16 +12,35 @@ public:
     
     int max_tokens = 512;
     int max_results = 5;
-    double similarity_threshold =0.6;
+    double similarity_threshold = 0.01; // RAG hits scoring below this are dropped
 
     // Runtime parameters
     int verbosity = 1;  // 0 = silent, 1 = normal, 2 = debug
     int max_retries = 3;
 
     // Resource controls
-    size_t memory_limit_mb = 256;   // soft cap for memory
+    size_t memory_limit_mb = 256;   // soft cap for the RAG index; 0 = none
+    std::string eviction_policy = "lru"; // chunks dropped over the cap: "lru" or "lfu"
     size_t disk_quota_mb = 512;     // max RAG/index size
 
+    // RAG search index: "flat" (exact scan), "hnsw" (approximate graph),
+    // "ivf" (k-means lists) or "binary" (sign-code Hamming scan + rescoring)
+    std::string ann_index = "flat";
+    size_t hnsw_m = 16;                 // graph links per node
+    size_t hnsw_ef_construction = 200;  // build-time candidate list
+    size_t hnsw_ef_search = 64;         // query-time candidate list
+    size_t ivf_nlist = 0;               // IVF lists; 0 = ~sqrt(chunks)
+    size_t ivf_nprobe = 8;              // IVF lists scanned per query
+    size_t binary_candidates = 256;     // binary: rows rescored exactly per query
+
+    // Dense embedding storage: "float32", "fp16"/"bf16" (2x smaller, near
+    // float recall; also halves rag_index.bin) or "int8" (4x smaller, approximate)
+    std::string embedding_storage = "float32";
+    size_t search_threads = 0;          // exact-scan threads; 0 = all cores, 1 = serial
+    // RAG result ranking: "topk" (best scores) or "mmr" (skips near-duplicates)
+    std::string retrieval_mode = "topk";
+    double mmr_lambda = 0.7;            // mmr: 1 = score only, 0 = variety only
+
     // Tool flags
     bool allow_web = true;
     bool allow_file_io = true;
@@ -1,7 +1,14 @@
 #pragma once
+#include "sparse_vector.h"
+#include "term_dictionary.h"
+#include "tokenizer.h"
+#include <atomic>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
 
 class EmbeddingEngine {
 public:
@@ -16,8 +23,30 @@ public:
 
     void setMethod(Method method);
 
-    // Create embedding vector for text
-    std::vector<float> embed(const std::string& text);
+    // TF-IDF corpus statistics. fit() starts over from the given texts,
+    // partialFit() adds one more document and unfit() takes one back out
+    // (pass the text that was fitted); other methods keep no state.
+    void fit(const std::vector<std::string>& corpus);
+    void partialFit(const std::string& text);
+    void unfit(const std::string& text);
+    // Starts over like fit() but keeps the tokenizer mode, so vectors
+    // stored under an older mode still match
+    void refit(const std::vector<std::string_view>& corpus);
+    // True when the statistics count exactly this many documents; always
+    // true for methods without statistics
+    bool coversDocuments(size_t count) const;
+
+    // Transform only: embedding never changes the corpus statistics, so a
+    // query vector is reproducible and any number of threads may embed at once
+    std::vector<float> embed(const std::string& text) const;
+
+    // Sparse embedding; native for TfIdf/WordHash, converted for dense methods
+    SparseVector embedSparse(const std::string& text) const;
+
+    // True when the current method is bag-of-terms (mostly-zero vectors)
+    bool producesSparse() const {
+        return method == Method::TfIdf || method == Method::WordHash;
+    }
 
     // Save/load engine state (method + TF-IDF vocab/stats)
     bool saveState(const std::string& filepath) const;
@@ -26,22 +55,50 @@ public:
 private:
     Method method;
     static constexpr size_t VOCAB_SIZE = 10000;
-    std::vector<std::string> documents; // tracks all indexed texts
-    // TF-IDF state
-    std::unordered_map<std::string, float> globalTermFreq;
-    std::unordered_map<std::string, size_t> documentFreq;
+    static constexpr uint32_t STATE_MAGIC = 0x4E454142;  // "BAEN"; older states start with the method
+    static constexpr uint32_t STATE_VERSION = 4;          // 2: interned vocabulary,
+                                                          // 3: tokenizer mode,
+                                                          // 4: no corpus term counts
+    // Queries against a published index snapshot embed (shared) while a
+    // reindex fits its chunks (exclusive)
+    mutable std::shared_mutex stateMutex;
+    size_t documentCount = 0;          // documents fitted; the N in IDF
+    // Tokenizer mode the statistics and stored vectors were built with;
+    // states from before code-aware splitting keep it off. Read without
+    // the lock by partialFit, which rechecks it under the lock.
+    std::atomic<bool> splitIdentifiers{ true };
+    // TF-IDF state: per term id, from the vocabulary
+    TermDictionary vocabulary;
+    std::vector<uint32_t> documentFreq;   // documents containing the term
+    std::vector<uint32_t> termBuckets;    // hashToIndex(term)
+
+    // Distinct terms of one text in first-seen order and their occurrences
+    struct TermCounts {
+        TermDictionary terms;
+        std::vector<uint32_t> counts;   // per terms id
+    };
+
+    // Callers hold stateMutex
+    std::vector<float> embedDense(const std::string& text) const;
+    SparseVector embedSparseTerms(const std::string& text) const;
 
     // Embedding implementations
-    std::vector<float> embedSimple(const std::string& text);
-    std::vector<float> embedTfIdf(const std::string& text);
-    std::vector<float> embedWordHash(const std::string& text);
-    std::vector<float> embedExternal(const std::string& text);
+    std::vector<float> embedSimple(const std::string& text) const;
+    SparseVector embedTfIdf(const std::string& text) const;
+    SparseVector embedWordHash(const std::string& text) const;
+    std::vector<float> embedExternal(const std::string& text) const;
 
     // Helpers
-    std::vector<std::string> tokenize(const std::string& text) const;
-    size_t hashToIndex(const std::string& term) const;
-    float calculateIdf(const std::string& term) const;
-    void updateVocabulary(const std::string& text);
+    // Tokenizes text once into counts (cleared first); returns the token count
+    static size_t countTerms(std::string_view text, bool split, TermCounts& counts);
+    static uint32_t hashToIndex(std::string_view term);
+    float calculateIdf(uint32_t id) const;
+    // Folds one document's counted terms into the corpus statistics
+    void updateVocabulary(const TermCounts& counts);
+    // Callers hold stateMutex exclusively
+    void fitLocked(const std::vector<std::string_view>& corpus);
     std::vector<float> normalizeVector(std::vector<float> vec) const;
+    SparseVector normalizeVector(SparseVector vec) const;
+    static SparseVector fromTermWeights(const std::unordered_map<uint32_t, float>& weights);
 };
 
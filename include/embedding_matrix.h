@@ -0,0 +1,56 @@
+#pragma once
+#include "shared_rows.h"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <vector>
+
+// Row-major float matrix used as the backing store for VectorStore
+// embeddings. Every row has the same dimension; the row stride is padded
+// up to a whole cache line so each row starts 64-byte aligned. Rows are
+// held in SharedRows blocks: copies share them until one side writes, and
+// a scan walks each block linearly.
+class EmbeddingMatrix {
+public:
+    using RowView = std::span<const float>;
+    using MutableRowView = std::span<float>;
+
+    static constexpr size_t ALIGNMENT = 64;                          // bytes
+    static constexpr size_t FLOATS_PER_LINE = ALIGNMENT / sizeof(float);
+
+    EmbeddingMatrix() = default;
+    explicit EmbeddingMatrix(size_t dim) { setDimension(dim); }
+
+    // Dimension can only change while the matrix holds no rows
+    bool setDimension(size_t dim);
+
+    size_t dim() const { return dimension; }
+    size_t stride() const { return rowStride; }
+    size_t rows() const { return buffer.size(); }
+    bool empty() const { return buffer.empty(); }
+
+    // Appends a row, zero-padding or truncating it to dim(). Returns row index.
+    size_t appendRow(RowView values);
+    // Overwrites row i the same way
+    void setRow(size_t i, RowView values);
+
+    RowView row(size_t i) const { return { buffer.row(i), dimension }; }
+    MutableRowView mutableRow(size_t i) { return { buffer.mutableRow(i), dimension }; }
+
+    // For blocked scans: this many rows, stride() floats apart, start at row(i)
+    size_t contiguousRows(size_t i) const { return buffer.contiguousRows(i); }
+
+    // Drops rows whose keep flag is 0; survivors keep their order
+    void keepRows(const std::vector<uint8_t>& keep);
+    void clear();
+
+    // Bulk (de)serialization: header + all rows in a single copy
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    SharedRows<float> buffer;
+    size_t dimension = 0;
+    size_t rowStride = 0;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include "shared_rows.h"
+#include "top_k.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <random>
+#include <span>
+#include <vector>
+
+// Hierarchical Navigable Small World graph over store rows. The graph only
+// knows row ids; all scoring goes through callbacks so the same index works
+// for dense and sparse rows and for any similarity (higher = closer).
+// Nodes sit in small SharedRows blocks: a copy that links in a few rows
+// copies only the blocks of the nodes whose links changed.
+class HnswIndex {
+public:
+    struct Params {
+        size_t M = 16;                 // links per node on upper layers (2*M on layer 0)
+        size_t efConstruction = 200;   // candidate list size while inserting
+        size_t efSearch = 64;          // candidate list size while querying
+    };
+
+    // Similarity between two rows already in the graph
+    using PairScore = std::function<float(uint32_t, uint32_t)>;
+    // Similarity between the current query and a row
+    using QueryScore = std::function<float(uint32_t)>;
+    // Whether a row may be returned; rejected rows are still traversed
+    using Accept = std::function<bool(uint32_t)>;
+
+    HnswIndex() = default;
+    explicit HnswIndex(const Params& params) : settings(params) {}
+
+    const Params& params() const { return settings; }
+    // efSearch applies immediately; M and efConstruction only on an empty graph
+    void setParams(const Params& params);
+
+    size_t size() const { return levels.size(); }
+    bool empty() const { return levels.empty(); }
+
+    // Links row size() into the graph
+    void insert(const PairScore& score);
+    void clear();
+
+    // With accept set, only accepted rows enter the results; the walk still
+    // passes through rejected rows so the graph stays connected
+    std::vector<SearchHit> search(const QueryScore& score, size_t topK,
+                                  const Accept& accept = nullptr) const;
+
+    // Typical bytes per node: its level and its layer-0 link slots
+    size_t rowBytes() const { return 1 + (1 + maxLinks(0)) * sizeof(uint32_t); }
+    static constexpr uint32_t FILE_MAGIC = 0x57534E48;  // "HNSW"
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    static constexpr int MAX_LEVEL = 16;
+    static constexpr size_t MAX_M = 512;   // largest M a saved graph may claim
+    static constexpr size_t NODE_BLOCK_ROWS = 64;
+
+    Params settings;
+    SharedRows<uint8_t> levels{ 1, NODE_BLOCK_ROWS };     // top layer of each node
+    SharedRows<uint32_t> baseLinks{ 1, NODE_BLOCK_ROWS }; // layer 0: per node [count, 2*M slots]
+    SharedRows<std::vector<uint32_t>> upperLinks{ 1, NODE_BLOCK_ROWS }; // layers 1..level: per layer [count, M slots]
+    uint32_t entryPoint = 0;
+    int maxLevel = -1;
+    std::mt19937 rng{0x5eed};
+
+    size_t maxLinks(int level) const { return level == 0 ? 2 * settings.M : settings.M; }
+    std::span<uint32_t> linkSlot(uint32_t node, int level);
+    std::span<const uint32_t> links(uint32_t node, int level) const;
+    void setLinks(uint32_t node, int level, const std::vector<uint32_t>& ids);
+    // Every level, link count, neighbour id and the entry point are in range
+    bool consistent() const;
+
+    int randomLevel();
+    std::vector<SearchHit> searchLayer(const std::vector<SearchHit>& entries,
+                                       const QueryScore& score, size_t ef, int level,
+                                       const Accept& accept = nullptr) const;
+    std::vector<uint32_t> selectNeighbors(const std::vector<SearchHit>& candidates,
+                                          size_t maxCount, const PairScore& score) const;
+};
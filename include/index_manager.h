@@ -2,30 +2,76 @@
 #include "vector_store.h"
 #include "embedding_engine.h"
 #include "chunkers/chunker.h"
+#include "config.h"
 #include <vector>
 #include <string>
 #include <memory>
-#include <shared_mutex>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
 
+// A retrieved chunk: index into the searched snapshot's chunks and its score
+struct ChunkHit {
+    size_t chunk;
+    float score;
+};
+
+// One immutable version of the index. Readers hold the snapshot they
+// started with, so a reindex never changes the rows or chunks under them.
+struct IndexSnapshot {
+    static constexpr size_t NO_CHUNK = static_cast<size_t>(-1);
+
+    explicit IndexSnapshot(EmbeddingEngine* eng) : store(eng) {}
+
+    VectorStore store;
+    // Chunks never change once added. The store and these arrays are held
+    // in SharedRows blocks, so a draft shares every block a write leaves alone.
+    SharedRows<std::shared_ptr<const CodeChunk>> chunks;
+    SharedRows<size_t> rowToChunk;    // store row -> index in chunks; NO_CHUNK for tombstones
+    size_t chunkBytes = 0;            // running total of the chunks' footprint
+
+    // Best chunks first; resolve metadata with *chunks[hit.chunk]. The
+    // filter is applied inside the store's search, before scoring.
+    std::vector<ChunkHit> retrieveChunks(const std::string& query, int topK,
+                                         const SearchFilter& filter = SearchFilter()) const;
+    // One hit list per query; cheaper than separate calls (see VectorStore::retrieveBatch)
+    std::vector<std::vector<ChunkHit>> retrieveChunksBatch(const std::vector<std::string>& queries,
+                                                           int topK,
+                                                           const SearchFilter& filter = SearchFilter()) const;
+};
 
+// Writers copy the published snapshot, change the copy and publish it with
+// one atomic pointer swap; readers never wait for an update to finish. The
+// copy shares its blocks with the published version, so a write costs
+// about what it changes.
+// Removed chunks leave tombstoned store rows, which a background thread
+// compacts away once they pile up.
 class IndexManager {
 public:
         explicit IndexManager(EmbeddingEngine* eng)
-        : store(eng) ,engine(eng){}
+        : engine(eng), current(std::make_shared<const IndexSnapshot>(eng)) {
+        compactor = std::thread([this] { compactLoop(); });
+    }
+    ~IndexManager();
 
     void init(const std::string& indexPath);
 
 
 
-    // Index a single file
+    // Index a single file, replacing the chunks it had before
     void indexFile(const std::string& filePath);
+    // Index several files in one draft, published once
+    void indexFiles(const std::vector<std::string>& filePaths);
 
-    // Index all files in a directory recursively
+    // Index all files in a directory recursively. Files whose mtime matches
+    // their indexed chunks are skipped; chunks of deleted files are dropped.
     void indexProject(const std::string& rootPath);
 
-    // Access indexed chunks
-    const std::vector<CodeChunk>& getChunks() const;
+    // The published version; keep the pointer while using its chunk indices
+    std::shared_ptr<const IndexSnapshot> snapshot() const { return current.load(); }
 
     // Save/load the index
     void saveIndex() const;
@@ -34,40 +80,81 @@ public:
     void loadIndex(const std::string& dbPath);
 
     void clear();
-    VectorStore store;
-    std::vector<std::pair<std::string,float>> retrieveChunks(const std::string& query, int topK) {
-        return store.retrieve(query, topK);
-    }
+
+    // Applies the storage and search settings (embedding_storage,
+    // similarity_threshold, retrieval_mode, mmr_lambda,
+    // ann_index, hnsw_*, ivf_*, binary_candidates)
+    // to the store, and memory_limit_mb / eviction_policy to the index
+    void applyConfig(const Config& config);
+    // Reruns k-means for the IVF index over the current chunks
+    void retrainIvf();
+    // Rescores with a new metric; ANN structures are rebuilt for it
+    void setSimilarity(std::unique_ptr<ISimilarity> sim);
+
 private:
         // Constants
+    static constexpr uint32_t INDEX_MAGIC = 0x58494142;  // "BAIX"
+    static constexpr uint32_t INDEX_VERSION = 5;          // 2: sparse chunk embeddings, 3: mtimes,
+                                                          // 4: fp16/bf16 values, 5: store row order
     static constexpr size_t MAX_FILE_SIZE = 10 * 1024 * 1024; // 10MB
     static constexpr size_t MAX_CHUNK_SIZE = 4096; // 4KB chunks
     static constexpr size_t MAX_CHUNKS = 10000;
-    static constexpr size_t MAX_TOTAL_SIZE = 100 * 1024 * 1024; // 100MB
+    static constexpr size_t DEFAULT_MEMORY_LIMIT = 256 * 1024 * 1024; // Config::memory_limit_mb
+    static constexpr size_t EVICT_TO_PERCENT = 90;  // eviction stops this far under a limit
 
     bool isSupportedExtension(const std::string& ext) {
         return SUPPORTED_EXTENSIONS.find(ext) != SUPPORTED_EXTENSIONS.end();
     }
 
-    std::unordered_map<std::string, size_t> codeToChunkIndex;
-
     inline static const std::set<std::string> SUPPORTED_EXTENSIONS = {
         ".txt", ".md", ".epub", ".pdf", ".cpp", ".h", ".hpp", ".c"
     };
 
-    std::vector<CodeChunk> chunks;
     EmbeddingEngine* engine;
-    std::shared_mutex chunksMutex;
+    std::atomic<std::shared_ptr<const IndexSnapshot>> current;
+    std::mutex writeMutex;   // one writer at a time; readers never take it
 
-    void addChunk(CodeChunk&& chunk);
-    void enforceMemoryLimits();
     std::string indexFilePath;
-
-    // Helper functions
-    void addChunkToIndex(CodeChunk&& chunk);
+    size_t memoryLimit = DEFAULT_MEMORY_LIMIT;   // bytes; 0 = unlimited. Writers only.
+
+    // Background compaction; publish() wakes the thread (see VectorStore::needsCompaction)
+    std::mutex compactMutex;
+    std::condition_variable compactWake;
+    bool compactPending = false;
+    bool stopping = false;
+    std::thread compactor;
+    void compactLoop();
+
+    // Where a draft's chunks are, so a changed file replaces its own chunks
+    struct ChunkLayout {
+        std::unordered_map<std::string, std::vector<size_t>> byFile;  // file -> chunk indices
+        std::vector<size_t> rowOf;   // chunk -> store row, NO_CHUNK if it has none
+        std::vector<uint8_t> keep;   // 0 marks chunks for eraseChunks(); shorter than chunks
+    };
+    static ChunkLayout layoutOf(const IndexSnapshot& next);
+
+    // Writer side: every helper below edits a draft, not the published snapshot
+    std::shared_ptr<IndexSnapshot> draft() const;
+    void publish(std::shared_ptr<IndexSnapshot> next);
+
+    bool overLimits(const IndexSnapshot& next) const;
+    // Evicts the chunks the store ranks coldest once MAX_CHUNKS or the memory
+    // limit is exceeded; nothing is re-embedded
+    void enforceMemoryLimits(IndexSnapshot& next);
+    // Drops chunks whose keep flag is 0 and tombstones their store rows.
+    // Flags past the end of keep count as 1. Returns how many were dropped.
+    size_t eraseChunks(IndexSnapshot& next, const std::vector<uint8_t>& keep);
+    // Drops the store's tombstoned rows and their rowToChunk entries
+    void compactStore(IndexSnapshot& next);
+    // Re-chunks and re-embeds one file. Its previous chunks are overwritten in
+    // place, surplus ones are flagged in layout.keep, extra ones are appended.
+    void indexFileInto(IndexSnapshot& next, const std::string& filePath, ChunkLayout& layout);
+    void replaceChunk(IndexSnapshot& next, size_t index, CodeChunk&& chunk, ChunkLayout& layout);
+    void loadIndexInto(IndexSnapshot& next, const std::string& dbPath);
+    void addChunkToIndex(IndexSnapshot& next, CodeChunk&& chunk);
+    void addChunkToStore(IndexSnapshot& next, size_t index);
     std::string limitText(const std::string& text, size_t maxChars);
-    void rebuildInternalStructures();
-    void removeChunksFromPath(const std::string& rootPath);
-    size_t getCurrentMemoryUsage() const;
+    static size_t chunkMemory(const CodeChunk& chunk);
+    // Chunks plus store; O(1) from running totals
+    static size_t getCurrentMemoryUsage(const IndexSnapshot& snap);
 };
-
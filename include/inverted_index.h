@@ -0,0 +1,52 @@
+#pragma once
+#include "sparse_vector.h"
+#include "shared_rows.h"
+#include "top_k.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Term -> posting list index over sparse (bag-of-terms) rows. Terms are the
+// EmbeddingEngine::hashToIndex buckets, i.e. the sparse vector indices.
+// Top-k uses WAND: documents whose per-term upper bounds cannot beat the
+// current k-th score are skipped without being scored. Terms and postings
+// sit in SharedRows blocks, so a copy that gains a document copies only
+// the blocks of the lists it lands in.
+class InvertedIndex {
+public:
+    // Cosine divides the accumulated dot product by both norms
+    enum class Scoring { Dot, Cosine };
+
+    // Number of term buckets; must be set before the first document
+    void setDimension(size_t dim);
+    size_t dim() const { return postings.size(); }
+
+    // doc ids must be added in increasing order (row index in the store)
+    void addDocument(uint32_t doc, SparseRowView row, float squaredNorm);
+    void clear();
+
+    // Whether a document may be returned; rejected ones are skipped unscored
+    using Accept = std::function<bool(uint32_t)>;
+
+    // Top-k documents with score >= minScore, best first. rowSquaredNorms
+    // is indexed by doc id and only read for Cosine.
+    std::vector<SearchHit> search(SparseRowView query, Scoring scoring, size_t topK,
+                            float minScore, const SharedRows<float>* rowSquaredNorms,
+                            const Accept& accept = nullptr) const;
+
+private:
+    static constexpr size_t TERM_BLOCK_ROWS = 64;
+    static constexpr size_t POSTING_BLOCK_ROWS = 128;
+
+    struct PostingList {
+        SharedRows<uint32_t> docs{ 1, POSTING_BLOCK_ROWS };   // increasing
+        SharedRows<float> weights{ 1, POSTING_BLOCK_ROWS };
+        // Extremes of weight and weight / |row| for upper bounds
+        float maxWeight = 0.0f, minWeight = 0.0f;
+        float maxScaled = 0.0f, minScaled = 0.0f;
+    };
+
+    SharedRows<PostingList> postings{ 1, TERM_BLOCK_ROWS };
+};
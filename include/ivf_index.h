@@ -0,0 +1,78 @@
+#pragma once
+#include "embedding_matrix.h"
+#include "shared_rows.h"
+#include "similarity.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <span>
+#include <vector>
+
+// Inverted-file index: k-means centroids partition the store rows into
+// lists, and a query only scans the rows of its nprobe closest lists.
+// Centroids are dense; rows are reached through callbacks so dense and
+// sparse stores share the index. Scores follow the store's similarity
+// (higher = closer). Each list is its own SharedRows block, so a copy that
+// adds or moves a row copies only the lists it touches.
+class IvfIndex {
+public:
+    struct Params {
+        size_t nlist = 0;        // number of lists; 0 picks ~sqrt(rows) at training time
+        size_t nprobe = 8;       // lists scanned per query
+        size_t iterations = 10;  // k-means rounds
+    };
+
+    // Adds row `row` into a dense accumulator of length dim
+    using AccumulateRow = std::function<void(uint32_t row, std::span<float> sum)>;
+    // Scores rows [begin, begin + count) against one centroid
+    using ScoreRows = std::function<void(std::span<const float> centroid,
+                                         size_t begin, size_t count, float* out)>;
+    // Scores the current query (or row being added) against every centroid
+    using ScoreCentroids = std::function<void(const RowBlock& centroids, float* out)>;
+
+    IvfIndex() = default;
+    explicit IvfIndex(const Params& params) : settings(params) {}
+
+    const Params& params() const { return settings; }
+    // nprobe applies immediately; a different nlist drops the centroids
+    void setParams(const Params& params);
+
+    bool trained() const { return !centroids.empty(); }
+    size_t dim() const { return centroids.dim(); }
+    size_t lists() const { return centroids.rows(); }
+    // Rows assigned to a list (kept in step with the store)
+    size_t size() const { return assignment.size(); }
+
+    // Runs k-means over rows [0, rows) and assigns every row
+    void train(size_t rows, size_t dim, const AccumulateRow& accumulate, const ScoreRows& score);
+    // Assigns row size() to its closest list; centroids stay fixed
+    void add(const ScoreCentroids& score);
+    // Moves a row whose vector changed to its nearest list
+    void reassign(uint32_t row, const ScoreCentroids& score);
+    // Drops the list contents but keeps the trained centroids
+    void clearLists();
+    void clear();
+
+    // Ids of the nprobe lists closest to the query, best first
+    std::vector<uint32_t> probe(const ScoreCentroids& score) const;
+    std::span<const uint32_t> list(size_t i) const { return members[i]; }
+
+    static constexpr uint32_t FILE_MAGIC = 0x4C465649;  // "IVFL"
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+
+    Params settings;
+    EmbeddingMatrix centroids;
+    std::vector<float> centroidNorms;             // |centroid|^2
+    SharedRows<std::vector<uint32_t>> members{ 1, 1 }; // list -> rows, ascending
+    SharedRows<uint32_t> assignment;                  // row -> list
+
+    // Scores against every centroid, one call per run of contiguous centroids
+    void scoreCentroids(const ScoreCentroids& score, float* out) const;
+    void updateNorms();
+    // Closest centroid for each row in [0, rows)
+    std::vector<uint32_t> assign(size_t rows, const ScoreRows& score) const;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include "embedding_matrix.h"
+#include "shared_rows.h"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <vector>
+
+// Rows held in a compact encoding; scans decode a block at a time into a
+// float buffer and reuse the float kernels on it.
+//  - Int8: value[d] ~= offset[d] + scale[d] * code[d], with a per-dimension
+//    range learned from a training set; a quarter of the float footprint
+//  - Float16 / BFloat16: IEEE half or bfloat16 values, half the footprint
+//    and nothing to learn. fp16 keeps 11 bits of mantissa, bf16 the float
+//    exponent range with 8.
+class QuantizedMatrix {
+public:
+    enum class Encoding : uint8_t { Int8, Float16, BFloat16 };
+
+    QuantizedMatrix() = default;
+
+    // Drops any stored codes and takes the rows' dimension; Int8 also learns
+    // its per-dimension ranges from them
+    void train(const EmbeddingMatrix& rows, Encoding encoding = Encoding::Int8);
+    bool trained() const { return dimension > 0; }
+    Encoding encoding() const { return format; }
+
+    size_t dim() const { return dimension; }
+    // Bytes per stored row
+    size_t stride() const { return rowStride; }
+    size_t rows() const { return codes.size(); }
+    bool empty() const { return codes.empty(); }
+
+    // Encodes a row, clamping values outside an Int8 range (fp16 overflows
+    // to infinity). Returns row index.
+    size_t appendRow(std::span<const float> values);
+    void setRow(size_t i, std::span<const float> values);
+    const uint8_t* row(size_t i) const { return reinterpret_cast<const uint8_t*>(codes.row(i)); }
+
+    // Decodes rows [begin, begin + count) into out, which has room for
+    // count rows of outStride floats
+    void decode(size_t begin, size_t count, float* out, size_t outStride) const;
+
+    // Drops rows whose keep flag is 0; survivors keep their order
+    void keepRows(const std::vector<uint8_t>& keep);
+    // Drops the rows but keeps the trained ranges
+    void clearRows();
+    void clear();
+
+    // The encoding is not written; the caller records it (see VectorStore)
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in, Encoding encoding);
+
+private:
+    static constexpr size_t ROW_ALIGNMENT = 16;   // bytes; keeps SIMD loads in-row
+
+    size_t valueBytes() const { return format == Encoding::Int8 ? 1 : 2; }
+    void setLayout(size_t dim, Encoding encoding);
+
+    Encoding format = Encoding::Int8;
+    size_t dimension = 0;
+    std::vector<float> scale;       // Int8 only
+    std::vector<float> offset;      // Int8 only
+    SharedRows<uint16_t> codes;     // rowStride bytes per row, 16-bit aligned for the halves
+    size_t rowStride = 0;
+};
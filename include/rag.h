@@ -20,7 +20,6 @@
 #include <vector>
 #include <memory>
 #include <set>
-#include <shared_mutex>
 
 // Core RAG pipeline manager
 class RAGPipeline {
@@ -29,10 +28,12 @@ public:
 
     std::string query(const std::string& query);
 
+    // filter restricts the search to matching chunks (path, extension, ...)
     std::vector<CodeChunk> retrieveRelevant(
         const std::string& query,
         const std::vector<int>& errorLines,
-        int topK = 3);
+        int topK = 3,
+        const SearchFilter& filter = SearchFilter());
 
     void clear();
 
@@ -42,7 +43,6 @@ public:
 
 private:
     Config* config;
-    mutable std::shared_mutex chunksMutex;
     //VectorStore store; // non-owning
     std::string indexFilePath;
     std::string limitText(const std::string& text, size_t maxChars);
@@ -0,0 +1,54 @@
+#pragma once
+#include "shared_rows.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-row retrieval history used to pick eviction victims: the tick of the
+// last search that returned the row and how many searches did. Searches
+// record through a const reference with relaxed atomics, so every reader of
+// a published store can update it at once. Copies share the counter blocks
+// (hits recorded on one show in the others) until one side changes rows.
+class RowAccessLog {
+public:
+    // Least recently returned first, or least often (ties: least recently)
+    enum class Policy { Lru, Lfu };
+
+    static constexpr size_t ROW_BYTES = sizeof(uint64_t) + sizeof(uint32_t);
+
+    // Process-wide logical clock; one tick per search
+    static uint64_t tick();
+
+    size_t rows() const { return lastHits.size(); }
+    // A new row counts as used now, so it is not the first to go
+    void append();
+    void record(uint32_t row, uint64_t now) const;
+    uint64_t lastHit(size_t row) const;
+    uint32_t hits(size_t row) const;
+    // Rows in the order they should be evicted
+    std::vector<uint32_t> coldestFirst(Policy policy) const;
+    // Drops rows whose keep flag is 0; survivors keep their order
+    void keepRows(const std::vector<uint8_t>& keep);
+    void clear();
+
+private:
+    // Readers may be recording into a block while a writer copies it, so
+    // the value is read and written atomically
+    template <typename T>
+    struct Counter {
+        mutable T value = 0;
+
+        Counter() = default;
+        Counter(T v) : value(v) {}
+        Counter(const Counter& other) : value(other.load()) {}
+        Counter& operator=(const Counter& other) {
+            value = other.load();
+            return *this;
+        }
+        T load() const { return std::atomic_ref<T>(value).load(std::memory_order_relaxed); }
+    };
+
+    SharedRows<Counter<uint64_t>> lastHits;
+    SharedRows<Counter<uint32_t>> hitCounts;
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include "shared_rows.h"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Attributes of one store row (for RAG, the chunk it was embedded from)
+struct RowMetadata {
+    std::string file;
+    std::string symbol;
+    int startLine = 0;
+    int endLine = 0;
+    int64_t timestamp = 0;   // file modification time, seconds since epoch
+};
+
+// Restricts a search to matching rows. Unset fields match everything;
+// every set field must match.
+struct SearchFilter {
+    std::string pathPrefix;               // file is this path or lies under it
+    std::vector<std::string> extensions;  // file extension is one of these (".h")
+    std::string symbol;                   // symbol name contains this
+    int minLine = 0;                      // row's line range overlaps [minLine, maxLine];
+    int maxLine = 0;                      // 0 leaves that end open
+    int64_t modifiedAfter = 0;            // timestamp >= this
+
+    bool empty() const {
+        return pathPrefix.empty() && extensions.empty() && symbol.empty()
+            && minLine == 0 && maxLine == 0 && modifiedAfter == 0;
+    }
+};
+
+// Column store of RowMetadata kept in step with the store rows. Strings are
+// interned, so a row holds a file id, a symbol id, its line range and a
+// timestamp; extensions are looked up per file. Columns are SharedRows and
+// the dictionaries are shared too, so copies only pay for what they change.
+class MetadataColumns {
+public:
+    // A SearchFilter evaluated against the dictionaries: per-id match tables,
+    // so testing a row costs a few array loads and no string work
+    class RowFilter {
+    public:
+        bool allows(size_t row) const {
+            const MetadataColumns& c = *columns;
+            return !c.deleted[row] && fileOk[c.fileIds[row]] && symbolOk[c.symbolIds[row]]
+                && (maxLine == 0 || c.startLines[row] <= maxLine)
+                && (minLine == 0 || c.endLines[row] >= minLine)
+                && c.timestamps[row] >= modifiedAfter;
+        }
+        // Rows the filter admits
+        size_t matches() const { return matchCount; }
+
+    private:
+        friend class MetadataColumns;
+        const MetadataColumns* columns = nullptr;
+        std::vector<uint8_t> fileOk;
+        std::vector<uint8_t> symbolOk;
+        int minLine = 0;
+        int maxLine = 0;
+        int64_t modifiedAfter = 0;
+        size_t matchCount = 0;
+    };
+
+    // Column bytes per row (interned strings are shared and not counted)
+    static constexpr size_t ROW_BYTES = 2 * sizeof(uint32_t) + 2 * sizeof(int32_t) + sizeof(int64_t)
+                                      + sizeof(uint8_t);
+
+    MetadataColumns() { clear(); }
+
+    size_t rows() const { return fileIds.size(); }
+
+    void append(const RowMetadata& meta);
+    // Overwrites the attributes of an existing row
+    void set(size_t row, const RowMetadata& meta);
+    RowMetadata get(size_t row) const;
+    // Drops rows whose keep flag is 0; survivors keep their order
+    void keepRows(const std::vector<uint8_t>& keep);
+    void clear();
+
+    // Tombstones: every RowFilter rejects a deleted row. Not persisted;
+    // the store drops such rows before saving.
+    void markDeleted(size_t row);
+    bool isDeleted(size_t row) const { return deleted[row] != 0; }
+    size_t deletedRows() const { return deletedCount; }
+
+    RowFilter compile(const SearchFilter& filter) const;
+
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    struct Dictionary {
+        std::vector<std::string> values;
+        std::unordered_map<std::string, uint32_t> ids;
+
+        uint32_t find(const std::string& value) const;
+        void clear();
+    };
+    static constexpr uint32_t NOT_INTERNED = UINT32_MAX;
+    // Looks the value up first, so a dictionary shared with other copies is
+    // only copied when a new string joins it
+    static uint32_t intern(std::shared_ptr<Dictionary>& dictionary, const std::string& value);
+
+    std::shared_ptr<Dictionary> files;     // id 0 is "" (no file)
+    std::shared_ptr<Dictionary> symbols;   // id 0 is "" (no symbol)
+    SharedRows<uint32_t> fileIds;
+    SharedRows<uint32_t> symbolIds;
+    SharedRows<int32_t> startLines;
+    SharedRows<int32_t> endLines;
+    SharedRows<int64_t> timestamps;
+    SharedRows<uint8_t> deleted;
+    size_t deletedCount = 0;
+};
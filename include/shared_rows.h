@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Makes *block safe to change: if another copy still holds it, this copy
+// gets its own and the other keeps the old contents.
+template <typename T>
+T& unshare(std::shared_ptr<T>& block) {
+    if (block.use_count() > 1) {
+        block = std::make_shared<T>(std::as_const(*block));
+    } else {
+        // Pairs with the release in the last other owner's reference drop,
+        // so its reads of the block finish before our writes
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *block;
+}
+
+// Rows of width() values each, held in blocks of blockRows() rows that
+// copies share. Copying costs one pointer per block; writing a row first
+// copies its block if another copy still holds it, so versions that differ
+// in a few rows share all the other blocks. Rows within a block are
+// contiguous, and each block starts on a 64-byte boundary.
+template <typename T>
+class SharedRows {
+public:
+    static constexpr size_t DEFAULT_BLOCK_ROWS = 256;
+
+    SharedRows() : SharedRows(1) {}
+    explicit SharedRows(size_t width, size_t blockRows = DEFAULT_BLOCK_ROWS)
+        : rowWidth(width), shift(std::countr_zero(std::bit_ceil(std::max<size_t>(1, blockRows)))),
+          mask((size_t{1} << shift) - 1) {}
+    SharedRows(const SharedRows&) = default;
+    SharedRows& operator=(const SharedRows&) = default;
+    SharedRows(SharedRows&& other) noexcept
+        : blocks(std::move(other.blocks)), rowWidth(other.rowWidth), shift(other.shift),
+          mask(other.mask), count(std::exchange(other.count, 0)) {}
+    SharedRows& operator=(SharedRows&& other) noexcept {
+        blocks = std::move(other.blocks);
+        rowWidth = other.rowWidth;
+        shift = other.shift;
+        mask = other.mask;
+        count = std::exchange(other.count, 0);
+        other.blocks.clear();
+        return *this;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t width() const { return rowWidth; }
+
+    const T* row(size_t i) const { return blocks[i >> shift]->data() + (i & mask) * rowWidth; }
+    const T& operator[](size_t i) const { return *row(i); }
+    const T& back() const { return *row(count - 1); }
+    // Rows from i to the end of its block: row(i) starts that many in a run
+    size_t contiguousRows(size_t i) const { return std::min(count - i, mask + 1 - (i & mask)); }
+
+    T* mutableRow(size_t i) { return unshare(blocks[i >> shift]).data() + (i & mask) * rowWidth; }
+    void set(size_t i, T value) { *mutableRow(i) = std::move(value); }
+
+    // Appends a row of value-initialized entries and returns it
+    T* appendRow() {
+        if ((count & mask) == 0) {
+            blocks.push_back(std::make_shared<Block>());
+            blocks.back()->reserve((mask + 1) * rowWidth);
+        }
+        Block& block = unshare(blocks.back());
+        block.resize(block.size() + rowWidth);
+        ++count;
+        return block.data() + block.size() - rowWidth;
+    }
+    void push_back(T value) { *appendRow() = std::move(value); }
+    void resize(size_t rows) {
+        truncate(rows);
+        while (count < rows) appendRow();
+    }
+    // Drops the rows from `rows` on
+    void truncate(size_t rows) {
+        if (rows >= count) return;
+        blocks.resize((rows + mask) >> shift);
+        if (size_t tail = rows & mask) unshare(blocks.back()).resize(tail * rowWidth);
+        count = rows;
+    }
+    // Drops rows whose keep flag is 0 (flags past the end count as 1);
+    // survivors keep their order
+    void keepRows(const std::vector<uint8_t>& keep) {
+        size_t out = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (i < keep.size() && !keep[i]) continue;
+            if (out != i) {
+                T* dst = mutableRow(out);
+                std::copy_n(row(i), rowWidth, dst);
+            }
+            ++out;
+        }
+        truncate(out);
+    }
+    void clear() {
+        blocks.clear();
+        count = 0;
+    }
+
+    // Every row's values as raw bytes, a block at a time
+    bool writeRows(std::ostream& out) const {
+        static_assert(std::is_trivially_copyable_v<T>);
+        for (size_t i = 0; i < count; i += contiguousRows(i)) {
+            out.write(reinterpret_cast<const char*>(row(i)), contiguousRows(i) * rowWidth * sizeof(T));
+        }
+        return static_cast<bool>(out);
+    }
+    // Replaces the contents with `rows` rows read as writeRows() wrote them
+    bool readRows(std::istream& in, size_t rows) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        clear();
+        while (count < rows && in) {
+            size_t start = count;
+            appendRow();
+            while (count < rows && (count & mask) != 0) appendRow();
+            in.read(reinterpret_cast<char*>(mutableRow(start)), (count - start) * rowWidth * sizeof(T));
+        }
+        return static_cast<bool>(in);
+    }
+
+    // Row-by-row iteration over the first value of each row
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator() = default;
+        const_iterator(const SharedRows* rows, size_t i) : rows(rows), i(i) {}
+        const T& operator*() const { return (*rows)[i]; }
+        const_iterator& operator++() {
+            ++i;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator before = *this;
+            ++i;
+            return before;
+        }
+        bool operator==(const const_iterator& other) const { return i == other.i; }
+
+    private:
+        const SharedRows* rows = nullptr;
+        size_t i = 0;
+    };
+    const_iterator begin() const { return { this, 0 }; }
+    const_iterator end() const { return { this, count }; }
+
+private:
+    template <typename U>
+    struct CacheLineAllocator {
+        using value_type = U;
+        static constexpr std::align_val_t ALIGNMENT{ 64 };
+        CacheLineAllocator() = default;
+        template <typename V>
+        CacheLineAllocator(const CacheLineAllocator<V>&) {}
+        U* allocate(size_t n) { return static_cast<U*>(::operator new(n * sizeof(U), ALIGNMENT)); }
+        void deallocate(U* p, size_t) { ::operator delete(p, ALIGNMENT); }
+        template <typename V>
+        bool operator==(const CacheLineAllocator<V>&) const { return true; }
+    };
+    using Block = std::vector<T, CacheLineAllocator<T>>;
+
+    std::vector<std::shared_ptr<Block>> blocks;
+    size_t rowWidth;
+    size_t shift;
+    size_t mask;
+    size_t count = 0;
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Float vector kernels used by the similarity metrics. The implementation
+// (AVX-512, AVX2+FMA, SSE4.1 or scalar) is picked once at startup from
+// CPUID; set BASIC_AGENT_SIMD=avx512|avx2|sse4|scalar to force a lower tier.
+namespace SimdKernels {
+    float dot(const float* a, const float* b, size_t n);
+
+    float squaredDistance(const float* a, const float* b, size_t n);
+
+    // One pass computing a·b, |a|^2 and |b|^2 (cosine)
+    void dotAndNorms(const float* a, const float* b, size_t n,
+                     float& dot, float& normA, float& normB);
+
+    // Int8 scalar dequantization: out[i] = offset[i] + scale[i] * codes[i]
+    void dequantizeInt8(const int8_t* codes, const float* scale, const float* offset,
+                        float* out, size_t n);
+
+    // IEEE fp16 and bfloat16 conversions (F16C, AVX-512F/BF16 or scalar),
+    // rounding to nearest even; fp16 overflows to infinity
+    void floatToHalf(const float* in, uint16_t* out, size_t n);
+    void halfToFloat(const uint16_t* in, float* out, size_t n);
+    void floatToBf16(const float* in, uint16_t* out, size_t n);
+    void bf16ToFloat(const uint16_t* in, float* out, size_t n);
+
+    // Hamming distance from query to each of count bit codes of `words`
+    // 64-bit words, stored back to back (POPCNT / AVX512-VPOPCNTDQ)
+    void hammingDistances(const uint64_t* query, const uint64_t* codes, size_t words,
+                          size_t count, uint32_t* out);
+
+    // Name of the selected implementation, e.g. "avx2"
+    const char* activeIsa();
+}
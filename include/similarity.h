@@ -2,37 +2,148 @@
 #ifndef SIMILARITY_H
 #define SIMILARITY_H
 
+#include "sparse_vector.h"
+#include <cstddef>
+#include <span>
 #include <vector>
 
+// A run of equally sized rows laid out at a fixed stride, e.g. a slice of an
+// EmbeddingMatrix. squaredNorms, when set, holds |row|^2 for each row;
+// unitNorm promises every row has |row| = 1.
+struct RowBlock {
+    const float* data = nullptr;
+    size_t stride = 0;
+    size_t dim = 0;
+    size_t count = 0;
+    const float* squaredNorms = nullptr;
+    bool unitNorm = false;
+
+    std::span<const float> row(size_t i) const { return { data + i * stride, dim }; }
+};
+
+// A run of CSR rows (a slice of a SparseMatrix). Row i spans
+// [offsets[i], offsets[i+1]) of indices/values; offsets has count + 1 entries.
+struct SparseRowBlock {
+    const size_t* offsets = nullptr;
+    const uint32_t* indices = nullptr;
+    const float* values = nullptr;
+    size_t count = 0;
+    const float* squaredNorms = nullptr;
+    bool unitNorm = false;
+
+    SparseRowView row(size_t i) const {
+        size_t b = offsets[i], e = offsets[i + 1];
+        return { { indices + b, e - b }, { values + b, e - b } };
+    }
+};
+
 class ISimilarity {
 public:
+    // How the score relates to the dot product. Indexes that accumulate
+    // per-term products (InvertedIndex) can serve Dot and CosineDot metrics.
+    enum class DotForm { None, Dot, CosineDot };
+
     virtual ~ISimilarity() = default;
-    virtual float operator()(const std::vector<float>& a,
-                             const std::vector<float>& b) const = 0;
+    virtual DotForm dotForm() const { return DotForm::None; }
+    // Views accept std::vector<float> as well as EmbeddingMatrix rows
+    virtual float operator()(std::span<const float> a,
+                             std::span<const float> b) const = 0;
+
+    // Scores one query against every row of a block: out[i] = sim(query, row i).
+    // The default calls operator() per row; metrics override it to hoist the
+    // per-pair checks and query-side work out of the loop.
+    virtual void scoreBlock(std::span<const float> query,
+                            const RowBlock& rows, float* out) const;
+
+    // Sparse-sparse pair. The default densifies both sides.
+    virtual float operator()(SparseRowView a, SparseRowView b) const;
+
+    // Sparse query against CSR rows. denseQuery is the query scattered into a
+    // buffer covering every row index, so each row costs O(nnz(row)).
+    virtual void scoreSparseBlock(SparseRowView query,
+                                  std::span<const float> denseQuery,
+                                  const SparseRowBlock& rows, float* out) const;
+
+    // Pruned variants for top-k scans: a row that provably scores below
+    // minScore may be abandoned part-way and reports -infinity; every other
+    // row gets its score. Dense rows are walked in query stripes, heaviest
+    // first, and dropped once the Cauchy-Schwarz bound on the rest of the
+    // dot product can no longer reach minScore. Needs cached row norms (or
+    // unitNorm); without them, and for metrics with no bound, every row is
+    // scored in full.
+    virtual void scoreBlockAbove(std::span<const float> query, const RowBlock& rows,
+                                 float minScore, float* out) const;
+    virtual void scoreSparseBlockAbove(SparseRowView query, std::span<const float> denseQuery,
+                                       const SparseRowBlock& rows, float minScore,
+                                       float* out) const;
+
+protected:
+    // Metrics whose score is a non-decreasing function of a·b once both
+    // squared norms are fixed (dot, cosine, Euclidean) override these two
+    // to enable the dot-product bound
+    virtual bool boundedByDot() const { return false; }
+    // Smallest a·b with which the pair can still score minScore
+    virtual float minDotFor(float minScore, float normSqA, float normSqB) const;
 };
 
 class CosineSimilarity : public ISimilarity {
 public:
-    float operator()(const std::vector<float>& a,
-                     const std::vector<float>& b) const override;
+    DotForm dotForm() const override { return DotForm::CosineDot; }
+    float operator()(std::span<const float> a,
+                     std::span<const float> b) const override;
+    void scoreBlock(std::span<const float> query,
+                    const RowBlock& rows, float* out) const override;
+    float operator()(SparseRowView a, SparseRowView b) const override;
+    void scoreSparseBlock(SparseRowView query, std::span<const float> denseQuery,
+                          const SparseRowBlock& rows, float* out) const override;
+
+protected:
+    bool boundedByDot() const override { return true; }
+    float minDotFor(float minScore, float normSqA, float normSqB) const override;
 };
 
 class EuclideanSimilarity : public ISimilarity {
 public:
-    float operator()(const std::vector<float>& a,
-                     const std::vector<float>& b) const override;
+    float operator()(std::span<const float> a,
+                     std::span<const float> b) const override;
+    void scoreBlock(std::span<const float> query,
+                    const RowBlock& rows, float* out) const override;
+    float operator()(SparseRowView a, SparseRowView b) const override;
+    void scoreSparseBlock(SparseRowView query, std::span<const float> denseQuery,
+                          const SparseRowBlock& rows, float* out) const override;
+
+protected:
+    bool boundedByDot() const override { return true; }
+    float minDotFor(float minScore, float normSqA, float normSqB) const override;
 };
 
 class DotProductSimilarity : public ISimilarity {
 public:
-    float operator()(const std::vector<float>& a,
-                     const std::vector<float>& b) const override;
+    DotForm dotForm() const override { return DotForm::Dot; }
+    float operator()(std::span<const float> a,
+                     std::span<const float> b) const override;
+    void scoreBlock(std::span<const float> query,
+                    const RowBlock& rows, float* out) const override;
+    float operator()(SparseRowView a, SparseRowView b) const override;
+    void scoreSparseBlock(SparseRowView query, std::span<const float> denseQuery,
+                          const SparseRowBlock& rows, float* out) const override;
+
+protected:
+    bool boundedByDot() const override { return true; }
+    float minDotFor(float minScore, float normSqA, float normSqB) const override;
 };
 
 class JaccardSimilarity : public ISimilarity {
 public:
-    float operator()(const std::vector<float>& a,
-                     const std::vector<float>& b) const override;
+    float operator()(std::span<const float> a,
+                     std::span<const float> b) const override;
+    float operator()(SparseRowView a, SparseRowView b) const override;
+    void scoreSparseBlock(SparseRowView query, std::span<const float> denseQuery,
+                          const SparseRowBlock& rows, float* out) const override;
+    // Bounded by the term counts: shared / union <= min(nnz) / max(nnz)
+    void scoreSparseBlockAbove(SparseRowView query, std::span<const float> denseQuery,
+                               const SparseRowBlock& rows, float minScore,
+                               float* out) const override;
 };
 
 #endif // SIMILARITY_H
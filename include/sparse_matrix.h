@@ -0,0 +1,61 @@
+#pragma once
+#include "sparse_vector.h"
+#include "shared_rows.h"
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+// Compressed sparse row (CSR) storage for sparse embeddings. Rows are cut
+// into blocks of BLOCK_ROWS, each with its own offsets, indices and values
+// arrays; copies of the matrix share the blocks until one side appends.
+class SparseMatrix {
+public:
+    SparseMatrix() = default;
+
+    // Dimension can only change while the matrix holds no rows
+    bool setDimension(size_t dim);
+
+    size_t dim() const { return dimension; }
+    static constexpr size_t BLOCK_ROWS = SharedRows<float>::DEFAULT_BLOCK_ROWS;
+
+    size_t rows() const { return rowCount; }
+    bool empty() const { return rowCount == 0; }
+    size_t nnz() const { return entryCount; }
+
+    // Appends a row; entries with index >= dim() are dropped. Returns row index.
+    size_t appendRow(SparseRowView row);
+
+    SparseRowView row(size_t i) const {
+        const Block& block = *blocks[i / BLOCK_ROWS];
+        size_t b = block.offsets[i % BLOCK_ROWS], e = block.offsets[i % BLOCK_ROWS + 1];
+        return { { block.indices.data() + b, e - b }, { block.values.data() + b, e - b } };
+    }
+
+    // Raw CSR arrays for blocked scans: the contiguousRows(i) rows from i
+    // have offsets from rowOffsets(i) into indexData(i) and valueData(i)
+    size_t contiguousRows(size_t i) const { return std::min(rowCount - i, BLOCK_ROWS - i % BLOCK_ROWS); }
+    const size_t* rowOffsets(size_t i) const { return blocks[i / BLOCK_ROWS]->offsets.data() + i % BLOCK_ROWS; }
+    const uint32_t* indexData(size_t i) const { return blocks[i / BLOCK_ROWS]->indices.data(); }
+    const float* valueData(size_t i) const { return blocks[i / BLOCK_ROWS]->values.data(); }
+
+    // Drops rows whose keep flag is 0; survivors keep their order
+    void keepRows(const std::vector<uint8_t>& keep);
+    void clear();
+
+    // Bulk (de)serialization: header + the three CSR arrays
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    struct Block {
+        std::vector<size_t> offsets{0};
+        std::vector<uint32_t> indices;
+        std::vector<float> values;
+    };
+
+    std::vector<std::shared_ptr<Block>> blocks;
+    size_t rowCount = 0;
+    size_t entryCount = 0;
+    size_t dimension = 0;
+};
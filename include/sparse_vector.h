@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Non-owning view of a sparse vector: strictly increasing indices with the
+// matching non-zero values.
+struct SparseRowView {
+    std::span<const uint32_t> indices;
+    std::span<const float> values;
+
+    size_t nnz() const { return indices.size(); }
+};
+
+// Sparse embedding (sorted index/value pairs) used by the bag-of-terms
+// methods, whose 10k-wide vectors are almost entirely zeros.
+struct SparseVector {
+    std::vector<uint32_t> indices;   // strictly increasing
+    std::vector<float> values;       // no explicit zeros
+    size_t dimension = 0;            // logical (dense) length
+
+    size_t nnz() const { return indices.size(); }
+    bool empty() const { return dimension == 0; }
+    SparseRowView view() const { return { indices, values }; }
+
+    float squaredNorm() const;
+    size_t memoryBytes() const {
+        return indices.size() * sizeof(uint32_t) + values.size() * sizeof(float);
+    }
+
+    std::vector<float> toDense() const;
+    static SparseVector fromDense(std::span<const float> dense);
+};
+
+namespace SparseKernels {
+    // Merge-join over two sorted index lists
+    float dot(SparseRowView a, SparseRowView b);
+
+    // Gather from a dense vector; indices must be < dense.size()
+    float dot(SparseRowView a, std::span<const float> dense);
+
+    size_t intersectionCount(SparseRowView a, SparseRowView b);
+
+    float squaredNorm(SparseRowView a);
+
+    // Writes a into dense (sized to at least the largest index + 1), zeroing the rest
+    void scatter(SparseRowView a, std::span<float> dense);
+}
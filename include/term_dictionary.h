@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+// Interned terms with dense ids 0..size()-1. Term bytes sit back to back
+// in one arena and lookups probe a flat open-addressing table of ids, so
+// there is no per-term heap string or node. Ids never change once given.
+class TermDictionary {
+public:
+    static constexpr uint32_t NO_TERM = UINT32_MAX;
+
+    size_t size() const { return offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+
+    // Id of term, adding it if new
+    uint32_t intern(std::string_view term);
+    // Id of term, or NO_TERM
+    uint32_t find(std::string_view term) const;
+    std::string_view term(uint32_t id) const {
+        return { arena.data() + offsets[id], offsets[id + 1] - offsets[id] };
+    }
+
+    void reserve(size_t terms);
+    void clear();
+
+    static constexpr uint32_t FILE_MAGIC = 0x4D524554;  // "TERM"
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    std::vector<char> arena;
+    std::vector<uint32_t> offsets{ 0 };   // term i is arena[offsets[i], offsets[i + 1])
+    std::vector<uint32_t> hashes;         // per id; checked before the bytes
+    std::vector<uint32_t> slots;          // power-of-two table of ids, NO_TERM = empty
+
+    static uint32_t hashOf(std::string_view term);
+    // Slot holding term, or the empty slot where it would go
+    size_t probe(std::string_view term, uint32_t hash) const;
+    void rehash(size_t capacity);
+};
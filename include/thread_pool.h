@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in every loop, so a pool of size n starts n - 1 workers.
+class ThreadPool {
+public:
+    using Task = std::function<void(size_t)>;
+
+    // 0 uses std::thread::hardware_concurrency()
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size() + 1; }
+
+    // Runs fn(i) for every i in [0, count) and returns once all calls are
+    // done. If another loop is already running, this one runs inline.
+    void parallelFor(size_t count, const Task& fn);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;            // one loop at a time
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const Task* job = nullptr;
+    size_t jobCount = 0;
+    std::atomic<size_t> nextIndex{0};
+    size_t activeWorkers = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void workerLoop();
+    void runTasks();
+};
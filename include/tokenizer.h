@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streams lowercase ASCII terms out of text in a single pass. Terms are
+// views into a buffer the tokenizer owns and reuses, so nothing is
+// allocated once the buffer has grown to the longest text seen; a view
+// stays valid until the next reset().
+//
+// With splitIdentifiers on, an identifier such as parseHTTPRequest,
+// max_chunk_size or std::vector yields its parts (parse, http, request)
+// followed by the whole identifier as written (parsehttprequest), so
+// queries match either form. Off, every run of letters and digits is one
+// term, which is how earlier indexes were built.
+class Tokenizer {
+public:
+    explicit Tokenizer(bool splitIdentifiers = true) : split(splitIdentifiers) {}
+
+    void setSplitIdentifiers(bool on) { split = on; }
+    bool splitIdentifiers() const { return split; }
+
+    // Starts over on text; text must outlive the calls to next()
+    void reset(std::string_view text);
+    // The next term, or false once the text is used up
+    bool next(std::string_view& term);
+
+    // All terms of text; views into this tokenizer's buffer
+    std::vector<std::string_view> tokenize(std::string_view text);
+
+private:
+    bool split;
+    std::string_view input;
+    std::string lowered;     // lowercase copy of the current word, at input offsets
+    size_t pos = 0;          // where the scan for the next word starts
+    size_t wordStart = 0;
+    size_t wordEnd = 0;
+    size_t partPos = 0;      // next part of the current word
+    size_t parts = 0;        // parts of the current word given out so far
+
+    size_t scanWord(size_t from);
+    size_t partEnd(size_t from) const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A scored store row
+struct SearchHit {
+    uint32_t doc;
+    float score;
+};
+
+// Bounded min-heap keeping the k best hits. Equal scores rank by lower doc,
+// so the kept set does not depend on the order hits are offered in.
+class TopK {
+public:
+    explicit TopK(size_t k) : k(k) { heap.reserve(k); }
+
+    size_t capacity() const { return k; }
+    size_t size() const { return heap.size(); }
+    bool full() const { return heap.size() >= k; }
+
+    // Score a newcomer must beat once the heap is full
+    float worstScore() const { return heap.front().score; }
+
+    bool offer(uint32_t doc, float score) {
+        if (k == 0) return false;
+        if (heap.size() < k) {
+            heap.push_back({ doc, score });
+            std::push_heap(heap.begin(), heap.end(), better);
+            return true;
+        }
+        if (!better({ doc, score }, heap.front())) return false;
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = { doc, score };
+        std::push_heap(heap.begin(), heap.end(), better);
+        return true;
+    }
+
+    // Best first; equal scores ordered by doc
+    std::vector<SearchHit> take() {
+        std::vector<SearchHit> out = std::move(heap);
+        heap.clear();
+        std::sort(out.begin(), out.end(), better);
+        return out;
+    }
+
+private:
+    size_t k;
+    std::vector<SearchHit> heap;
+
+    // Heap order puts the worst kept hit at the front
+    static bool better(const SearchHit& a, const SearchHit& b) {
+        return a.score != b.score ? a.score > b.score : a.doc < b.doc;
+    }
+};
@@ -1,41 +1,300 @@
 #pragma once
 #include "similarity.h"
 #include "embedding_engine.h"
+#include "embedding_matrix.h"
+#include "sparse_matrix.h"
+#include "inverted_index.h"
+#include "hnsw_index.h"
+#include "ivf_index.h"
+#include "binary_index.h"
+#include "quantized_matrix.h"
+#include "row_metadata.h"
+#include "row_access.h"
+#include "shared_rows.h"
+#include "thread_pool.h"
 
 #include <string>
 #include <vector>
 #include <utility>
 #include <memory>
+#include <algorithm>
 
+// Copies are independent versions of the store (IndexManager publishes them
+// as snapshots); the const members may run from several threads at once.
+// Every per-row structure is held in SharedRows blocks, so a copy shares
+// all rows with the original and each write copies only the blocks it
+// lands in.
 class VectorStore {
 public:
+    // How retrieve() finds candidates: exact scan (WAND for sparse dot/cosine),
+    // the approximate HNSW graph, IVF lists around k-means centroids, or a
+    // Hamming scan over one-bit sign codes whose closest rows are rescored
+    enum class SearchIndex { Flat, Hnsw, Ivf, Binary };
+    // Dense rows are held as float32, as int8 codes (a quarter of the size)
+    // or as fp16/bf16 values (half the size, near-float recall)
+    enum class Storage { Float32, Int8, Float16, BFloat16 };
+
     // non-owning pointer: RAGPipeline owns the engine via unique_ptr
     explicit VectorStore(EmbeddingEngine* engine)
         : embeddingEngine(engine) {}
 
 
+    // Row text is held by shared pointer: copies of the store share it, and
+    // a caller that keeps the text itself (IndexManager's chunks) can hand
+    // it over instead of having it copied
+    using SharedText = std::shared_ptr<const std::string>;
+
     void setSimilarity(std::unique_ptr<ISimilarity> sim);
+    // Embeds text and fits it into the engine's statistics; removing or
+    // replacing the row takes it back out
     void addDocument(const std::string& text);
+    // Adds a document whose embedding was already computed (e.g. loaded from disk)
+    void addDocument(const std::string& text, const std::vector<float>& embedding);
+    void addDocument(const std::string& text, const SparseVector& embedding);
+    void addDocument(SharedText text, const std::vector<float>& embedding);
+    void addDocument(SharedText text, const SparseVector& embedding);
     void addDocuments(const std::vector<std::string>& texts);
+    // Tombstones the row: searches skip it at once and its text is freed,
+    // while its vector stays until compact(). Row numbers do not change.
+    bool removeDocument(size_t row);
+    // Replaces a live row's text and embedding. Dense rows are overwritten in
+    // place (IVF moves them to their new list); HNSW and sparse rows are
+    // tombstoned and re-added with their metadata, as is a row that is not
+    // live. Returns the row now holding the document.
+    size_t updateDocument(size_t row, const std::string& text, const std::vector<float>& embedding);
+    size_t updateDocument(size_t row, const std::string& text, const SparseVector& embedding);
+    size_t updateDocument(size_t row, SharedText text, const std::vector<float>& embedding);
+    size_t updateDocument(size_t row, SharedText text, const SparseVector& embedding);
+
+    // Rows are kept dense or CSR depending on the first embedding added
+    bool isSparse() const { return layout == Layout::Sparse; }
+    // Float rows; empty while the rows are held as int8 codes
+    const EmbeddingMatrix& getEmbeddings() const { return embeddings; }
+    const SparseMatrix& getSparseEmbeddings() const { return sparseEmbeddings; }
+    // Rows, tombstones included; liveSize() leaves them out
+    size_t size() const { return documents.size(); }
+    size_t liveSize() const { return documents.size() - metadata.deletedRows(); }
+    bool isDeleted(size_t row) const { return metadata.isDeleted(row); }
+    size_t deletedRows() const { return metadata.deletedRows(); }
+    // True once COMPACT_DEAD_SHARE of the rows are tombstones
+    bool needsCompaction() const;
+    // Drops the tombstoned rows: later rows move down in order to close the
+    // gaps, and postings and ANN structures are rebuilt from the kept vectors
+    void compact();
+    // Rows start with empty metadata; set it to make them reachable by filters
+    void setRowMetadata(size_t row, const RowMetadata& meta) { metadata.set(row, meta); }
+    RowMetadata getRowMetadata(size_t row) const { return metadata.get(row); }
+    // True while every row has unit length (within UNIT_NORM_TOLERANCE), so
+    // cosine reduces to a dot product and Euclidean to 2 - 2 dot
+    bool hasUnitRows() const { return unitRows && !squaredNorms.empty(); }
+
+    // Int8 learns its ranges once QUANTIZE_MIN_ROWS dense rows exist and
+    // keeps them across clear(); fp16/bf16 encode rows as they arrive.
+    // Switching encodings decodes the rows (their rounding error stays).
+    void setStorage(Storage mode);
+    Storage getStorage() const { return storage; }
+    // Dense rows are held encoded rather than as floats
+    bool isQuantized() const { return storage != Storage::Float32 && quantized.trained(); }
+    // Rows scoring below the threshold are never returned. The exact scan
+    // also abandons rows that provably cannot beat it or the current k-th
+    // best score (see ISimilarity::scoreBlockAbove).
+    void setScoreThreshold(float threshold) { scoreThreshold = threshold; }
+    float getScoreThreshold() const { return scoreThreshold; }
+    // Maximal marginal relevance: below 1, results are picked one at a time
+    // from MMR_POOL_FACTOR * topK candidates by
+    //   lambda * score - (1 - lambda) * (similarity to the closest one picked),
+    // so near-duplicate chunks give way to other matches. 1 ranks by score.
+    void setDiversity(float lambda) { mmrLambda = std::clamp(lambda, 0.0f, 1.0f); }
+    float getDiversity() const { return mmrLambda; }
+    // Threads for the exact scan; 0 uses every core, 1 scans serially
+    void setSearchThreads(size_t threads);
+    size_t getSearchThreads() const { return pool ? pool->size() : 1; }
+
+    // Switching to Hnsw links every row into the graph; IVF and Binary train
+    // in prepareSearch() if they have no centroids / thresholds yet. Inactive
+    // indexes drop their graph, lists and codes, but IVF centroids and sign
+    // thresholds are kept (as by clear()), so switching back reassigns rows
+    // instead of retraining.
+    void setSearchIndex(SearchIndex index);
+    SearchIndex getSearchIndex() const { return searchIndex; }
+    // A changed M or efConstruction rebuilds the graph; efSearch applies at once
+    void setHnswParams(const HnswIndex::Params& params);
+    const HnswIndex::Params& getHnswParams() const { return hnsw.params(); }
+    // A changed nlist drops the centroids; nprobe applies at once
+    void setIvfParams(const IvfIndex::Params& params);
+    const IvfIndex::Params& getIvfParams() const { return ivf.params(); }
+    // Reruns k-means over the current rows and reassigns them
+    bool trainIvf();
+    size_t ivfLists() const { return ivf.lists(); }
+    // candidates applies at once
+    void setBinaryParams(const BinaryIndex::Params& params) { binary.setParams(params); }
+    const BinaryIndex::Params& getBinaryParams() const { return binary.params(); }
+    // Finishes index work deferred from the writes (IVF/Binary training) so the
+    // const search paths find it ready; untrained IVF falls back to a scan
+    void prepareSearch();
+    // Mean recall@topK of the active index against an exact scan, using up
+    // to sampleQueries evenly spaced stored rows as queries
+    double measureRecall(size_t sampleQueries, int topK) const;
+    // Saves the active ANN index with a fingerprint of the rows it was built
+    // over. A loaded graph, IVF lists or sign codes are only adopted if the
+    // store holds those same rows in the same order; IVF centroids and sign
+    // thresholds are kept either way and the rows are assigned afresh.
+    bool saveAnnIndex(const std::string& path) const;
+    bool loadAnnIndex(const std::string& path);
+    // Hash of every row's text in row order; tells whether saved ANN
+    // structures describe the rows now in the store
+    uint64_t rowFingerprint() const;
 
-    std::vector<std::vector<float>> embeddings;
     bool loadEmbeddings(const std::string& path);
     bool saveEmbeddings(const std::string& filepath) const;
-    void enforceMemoryLimit(size_t maxMemoryBytes);
+    // Bytes held by the live rows (text, vectors, norms, metadata, graph
+    // links), from running totals: O(1), and it drops as rows are removed
     size_t getMemoryUsage() const;
+    // What removing the row frees, on the same scale
+    size_t rowMemoryBytes(size_t row) const;
+    // Eviction order: rows least recently (Lru) or least often (Lfu)
+    // returned by retrieve() go first; rows added later count as recent
+    void setEvictionPolicy(RowAccessLog::Policy policy) { evictionPolicy = policy; }
+    RowAccessLog::Policy getEvictionPolicy() const { return evictionPolicy; }
+    std::vector<uint32_t> evictionOrder() const;
+    // Compacts, then evicts live rows in eviction order until
+    // getMemoryUsage() <= maxMemoryBytes. Returns how many were evicted.
+    size_t enforceMemoryLimit(size_t maxMemoryBytes);
+    // removeDocument() for each row, then compact(); nothing is re-embedded
+    void removeRows(const std::vector<uint32_t>& rows);
 
     void clear();
 
 
-    std::vector<std::pair<std::string, float>> retrieve(const std::string& query, int topK = 3);
+    // Best rows first. Row i is the i-th document added since clear(); callers
+    // keep their own row -> record mapping. Rows the filter rejects are never
+    // scored (HNSW still walks through them).
+    std::vector<SearchHit> retrieve(const std::string& query, int topK = 3,
+                                    const SearchFilter& filter = SearchFilter()) const;
+    // One result list per query, in order. All queries are embedded first and
+    // the exact scan reads each block of rows once for the whole batch.
+    std::vector<std::vector<SearchHit>> retrieveBatch(const std::vector<std::string>& queries,
+                                                      int topK = 3,
+                                                      const SearchFilter& filter = SearchFilter()) const;
 
 private:
-    static constexpr float SIMILARITY_THRESHOLD = 0.01f;
+    static constexpr float DEFAULT_SCORE_THRESHOLD = 0.01f;
+    // Target bytes of rows scored per scoreBlock() call (fits in L2)
+    static constexpr size_t SCAN_BLOCK_BYTES = 256 * 1024;
+    static constexpr size_t MIN_SCAN_BLOCK_ROWS = 8;
+    static constexpr size_t SPARSE_SCAN_BLOCK_ROWS = 256;
+    static constexpr size_t QUANTIZE_MIN_ROWS = 256;   // rows to learn int8 ranges from
+    static constexpr size_t MMR_POOL_FACTOR = 4;       // candidates per result MMR chooses from
+    static constexpr uint8_t QUANTIZED_FILE_TAG = 2;   // layout byte for int8 rows on disk
+    static constexpr uint8_t FP16_FILE_TAG = 3;        // ... fp16 rows
+    static constexpr uint8_t BF16_FILE_TAG = 4;        // ... bf16 rows
+    static constexpr size_t PARALLEL_MIN_ROWS = 4096;  // smaller stores scan on the caller
+    static constexpr float UNIT_NORM_TOLERANCE = 1e-4f; // | |row|^2 - 1 | for a unit row
+    static constexpr size_t FILTERED_ANN_MIN_SHARE = 10; // filters keeping < 1/10 of rows scan exactly
+    static constexpr size_t COMPACT_DEAD_SHARE = 5;      // compact once 1/5 of the rows are tombstones
+    static constexpr uint32_t ANN_FILE_MAGIC = 0x524E4E41; // "ANNR": .ann header before the index
+
+    enum class Layout : uint8_t { Dense, Sparse };
+    using RowFilter = MetadataColumns::RowFilter;
+
+    // An embedded query; for the sparse layout dense holds it scattered
+    struct QueryVector {
+        SparseVector sparse;
+        std::vector<float> dense;
+    };
+
+    SharedRows<SharedText> documents; // null once the row is tombstoned
+    SharedRows<uint8_t> fitted;       // 1: addDocument(text) fitted the row's text into the engine
+    size_t documentBytes = 0;         // sum of the documents' sizes
+    Layout layout = Layout::Dense;
+    EmbeddingMatrix embeddings;       // Dense layout: row i belongs to documents[i]
+    SparseMatrix sparseEmbeddings;    // Sparse layout: row i belongs to documents[i]
+    QuantizedMatrix quantized;        // Dense layout, encoded storage: replaces embeddings
+    Storage storage = Storage::Float32;
+    float scoreThreshold = DEFAULT_SCORE_THRESHOLD;
+    float mmrLambda = 1.0f;
+    SharedRows<float> squaredNorms;   // |row i|^2, kept in step with the rows
+    bool unitRows = true;             // every squaredNorms entry is ~1
+    InvertedIndex invertedIndex;      // Sparse layout: term bucket -> rows
+    SearchIndex searchIndex = SearchIndex::Flat;
+    HnswIndex hnsw;                   // Hnsw: graph over rows, kept in step on add
+    IvfIndex ivf;                     // Ivf: centroids survive clear(), lists follow rows
+    BinaryIndex binary;               // Binary: thresholds survive clear(), codes follow rows
+    MetadataColumns metadata;         // row i's file, symbol, lines and timestamp
+    RowAccessLog access;              // row i's search hits; picks eviction victims
+    RowAccessLog::Policy evictionPolicy = RowAccessLog::Policy::Lru;
+    size_t searchThreads = 1;
+    std::shared_ptr<ThreadPool> pool; // null while searchThreads == 1; shared by copies
+
+    bool canUseInvertedIndex() const;
+
+    void appendRow(std::span<const float> embedding);
+    void appendRow(const SparseVector& embedding);
+    void pushNorm(float squaredNorm);
+    // Sets the layout and dimension from the first row with values
+    void startLayout(Layout rowLayout, size_t dim);
+    void pushDocument(SharedText text);
+    void unfitRow(size_t row);
+    static size_t textSize(const SharedText& text) { return text ? text->size() : 0; }
+    // Re-adds a row's document elsewhere: tombstone, append, copy metadata
+    template <typename Embedding>
+    size_t moveDocument(size_t row, SharedText text, const Embedding& embedding);
+    // The search filter plus the tombstones; null when neither rejects a row
+    const RowFilter* compileFilter(const SearchFilter& filter, RowFilter& storage) const;
+    size_t fixedRowBytes() const;
+    void recomputeNorms(std::vector<float> savedNorms = {});
+    void quantizeRows();
+    void decodeRows();
+    // Float rows needed before encoding: QUANTIZE_MIN_ROWS for Int8, else one
+    size_t encodeMinRows() const;
+    void syncAnnIndex();
+    void syncIvf();
+    void syncBinary();
+    // Row i as a dense vector (sparse rows are scattered into scratch)
+    std::span<const float> rowVector(size_t row, std::vector<float>& scratch) const;
+    bool annReady() const;
+    size_t rowDimension() const;
+    void accumulateRow(uint32_t row, std::span<float> sum) const;
+    void scoreRowsAgainst(std::span<const float> centroid, size_t begin, size_t count,
+                          float* out) const;
+
+    bool embedQuery(const std::string& text, QueryVector& query) const;
+    QueryVector rowQuery(size_t row) const;
+    float scoreRow(const QueryVector& query, size_t row) const;
+    float pairScore(uint32_t a, uint32_t b) const;
+    // A null filter admits every row
+    std::vector<SearchHit> exactSearch(const QueryVector& query, size_t topK, float minScore,
+                                       const RowFilter* filter = nullptr) const;
+    // Full scan for a batch of queries, one result list per query
+    std::vector<std::vector<SearchHit>> scanSearch(std::span<const QueryVector> queries,
+                                                   size_t topK, float minScore,
+                                                   const RowFilter* filter) const;
+    // Scans rows [begin, end) into heaps[q] for each query q
+    void scanRows(std::span<const QueryVector> queries, size_t begin, size_t end, float minScore,
+                  const RowFilter* filter, std::vector<TopK>& heaps) const;
+    std::vector<SearchHit> annSearch(const QueryVector& query, size_t topK, float minScore,
+                                     const RowFilter* filter = nullptr) const;
+    std::vector<SearchHit> ivfSearch(const QueryVector& query, size_t topK, float minScore,
+                                     const RowFilter* filter) const;
+    std::vector<SearchHit> binarySearch(const QueryVector& query, size_t topK, float minScore,
+                                        const RowFilter* filter) const;
 
-    std::vector<std::string> documents;
+    size_t scanBlockRows() const;
+    // Rows from first, at most limit, that one RowBlock / SparseRowBlock may
+    // cover: rows and norms share SharedRows block boundaries
+    size_t runRows(size_t first, size_t limit) const {
+        return std::min(limit, squaredNorms.contiguousRows(first));
+    }
+    // Dense rows as floats; int8 rows are decoded into scratch. The rows
+    // must lie in one run (see runRows).
+    RowBlock rowBlock(size_t begin, size_t count, std::vector<float>& scratch) const;
+    std::span<const float> denseRow(size_t row, std::vector<float>& scratch) const;
+    SparseRowBlock sparseRowBlock(size_t begin, size_t count) const;
+    // Greedy MMR over candidates sorted best first; scores stay relevance
+    std::vector<SearchHit> diversify(const std::vector<SearchHit>& pool, size_t topK) const;
 
     EmbeddingEngine* embeddingEngine;  // non-owning raw pointer
-    std::unique_ptr<ISimilarity> similarity =
-        std::make_unique<DotProductSimilarity>();
+    std::shared_ptr<const ISimilarity> similarity =
+        std::make_shared<DotProductSimilarity>();
 };
 
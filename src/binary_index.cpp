@@ -0,0 +1,125 @@
+#include "../include/binary_index.h"
+#include "../include/simd_kernels.h"
+#include <algorithm>
+#include <istream>
+#include <limits>
+#include <ostream>
+
+void BinaryIndex::train(size_t rows, size_t dim, const AccumulateRow& accumulate) {
+    clear();
+    if (rows == 0 || dim == 0) return;
+
+    std::vector<float> sum(dim, 0.0f);
+    for (size_t r = 0; r < rows; ++r) accumulate(static_cast<uint32_t>(r), sum);
+    thresholds.resize(dim);
+    for (size_t d = 0; d < dim; ++d) thresholds[d] = sum[d] / static_cast<float>(rows);
+    words = (dim + 63) / 64;
+    codes = SharedRows<uint64_t>(words);
+}
+
+void BinaryIndex::encode(std::span<const float> row, uint64_t* out) const {
+    std::fill_n(out, words, 0);
+    size_t n = std::min(row.size(), thresholds.size());
+    for (size_t d = 0; d < n; ++d) {
+        out[d / 64] |= static_cast<uint64_t>(row[d] > thresholds[d]) << (d % 64);
+    }
+    // Missing trailing values count as 0
+    for (size_t d = n; d < thresholds.size(); ++d) {
+        out[d / 64] |= static_cast<uint64_t>(0.0f > thresholds[d]) << (d % 64);
+    }
+}
+
+void BinaryIndex::add(std::span<const float> row) {
+    encode(row, codes.appendRow());
+}
+
+void BinaryIndex::setRow(size_t i, std::span<const float> row) {
+    if (i < codes.size()) encode(row, codes.mutableRow(i));
+}
+
+void BinaryIndex::clearCodes() {
+    codes.clear();
+}
+
+void BinaryIndex::clear() {
+    clearCodes();
+    thresholds.clear();
+    words = 0;
+}
+
+std::vector<uint32_t> BinaryIndex::nearest(std::span<const float> query, size_t count,
+                                           const Accept& accept) const {
+    std::vector<uint32_t> rows;
+    size_t rowCount = codes.size();
+    if (!trained() || rowCount == 0 || count == 0) return rows;
+
+    std::vector<uint64_t> code(words);
+    encode(query, code.data());
+    std::vector<uint32_t> distance(rowCount);
+    for (size_t r = 0; r < rowCount; r += codes.contiguousRows(r)) {
+        SimdKernels::hammingDistances(code.data(), codes.row(r), words, codes.contiguousRows(r),
+                                      distance.data() + r);
+    }
+
+    // Distances are bounded by dim, so a histogram finds the cut in one pass
+    const uint32_t rejected = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> histogram(dim() + 1, 0);
+    size_t accepted = 0;
+    for (size_t r = 0; r < rowCount; ++r) {
+        if (accept && !accept(static_cast<uint32_t>(r))) {
+            distance[r] = rejected;
+            continue;
+        }
+        ++histogram[distance[r]];
+        ++accepted;
+    }
+    count = std::min(count, accepted);
+    if (count == 0) return rows;
+
+    uint32_t cut = 0;
+    size_t below = 0;   // rows strictly closer than cut
+    while (below + histogram[cut] < count) below += histogram[cut++];
+    size_t atCut = count - below;
+
+    rows.reserve(count);
+    for (size_t r = 0; r < rowCount; ++r) {
+        if (distance[r] < cut) {
+            rows.push_back(static_cast<uint32_t>(r));
+        } else if (distance[r] == cut && atCut > 0) {
+            rows.push_back(static_cast<uint32_t>(r));
+            --atCut;
+        }
+    }
+    return rows;
+}
+
+// ------------------------------------------------------------------
+// Persistence: magic, candidates, dim, rows, thresholds, codes
+// ------------------------------------------------------------------
+bool BinaryIndex::write(std::ostream& out) const {
+    uint64_t header[3] = { settings.candidates, dim(), codes.size() };
+    out.write(reinterpret_cast<const char*>(&FILE_MAGIC), sizeof(FILE_MAGIC));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(thresholds.data()), thresholds.size() * sizeof(float));
+    return codes.writeRows(out);
+}
+
+bool BinaryIndex::read(std::istream& in) {
+    uint32_t magic = 0;
+    uint64_t header[3] = {};
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in || magic != FILE_MAGIC) return false;
+
+    clear();
+    settings.candidates = header[0];
+    thresholds.resize(header[1]);
+    words = (thresholds.size() + 63) / 64;
+    codes = SharedRows<uint64_t>(words);
+    in.read(reinterpret_cast<char*>(thresholds.data()), thresholds.size() * sizeof(float));
+    if (!in || !codes.readRows(in, header[2])) {
+        clear();
+        return false;
+    }
+    return true;
+}
@@ -1,6 +1,7 @@
 #include "command_processor.h"
 #include "file_handler.h"
 #include "index_manager.h"
+#include "simd_kernels.h"
 
 #include <algorithm>
 #include <cctype>
@@ -9,6 +10,7 @@
 #include <regex>
 #include <filesystem>
 #include <fstream>
+#include <chrono>
 
 namespace fs = std::filesystem;
 
@@ -20,7 +22,8 @@ CommandProcessor::CommandProcessor(Memory& mem,
       rag(ragPipeline),
       llm(llmInterface),
       promptFactory(mem, ragPipeline),
-      indexManager(ragPipeline.getIndexManager()) // pointer getter
+      indexManager(ragPipeline.getIndexManager()), // pointer getter
+      config(cfg)
 {
     initializeCommands();
     
@@ -52,10 +55,83 @@ void CommandProcessor::handleSimilarityCommand(const std::string& args) {
     }
 
     // Apply the chosen similarity
-    rag.getIndexManager()->store.setSimilarity(std::move(it->second));
-    std::cout << "Similarity set to " << chosen << "\n";
+    rag.getIndexManager()->setSimilarity(std::move(it->second));
+    std::cout << "Similarity set to " << chosen
+              << " (kernels: " << SimdKernels::activeIsa() << ")\n";
 }
 
+void CommandProcessor::handleIndexCommand(const std::string& args) {
+    std::istringstream iss(toLower(trim(args)));
+    std::string sub;
+    iss >> sub;
+    // Reads go to the published snapshot; reload it after a write
+    auto snap = indexManager->snapshot();
+    const VectorStore* store = &snap->store;
+
+    if (sub.empty()) {
+        std::cout << "Search index: ";
+        switch (store->getSearchIndex()) {
+        case VectorStore::SearchIndex::Hnsw: {
+            const auto& p = store->getHnswParams();
+            std::cout << "hnsw (M=" << p.M << ", efConstruction=" << p.efConstruction
+                      << ", efSearch=" << p.efSearch << ")";
+            break;
+        }
+        case VectorStore::SearchIndex::Ivf:
+            std::cout << "ivf (lists=" << store->ivfLists()
+                      << ", nprobe=" << store->getIvfParams().nprobe << ")";
+            break;
+        case VectorStore::SearchIndex::Binary:
+            std::cout << "binary (candidates=" << store->getBinaryParams().candidates << ")";
+            break;
+        default:
+            std::cout << "flat";
+        }
+        std::cout << ", rows=" << store->liveSize();
+        if (store->deletedRows() > 0) std::cout << " (+" << store->deletedRows() << " deleted)";
+        std::cout << "\n"
+                  << "Usage: /index flat | hnsw | ivf | binary | retrain | recall [queries]\n";
+        return;
+    }
+
+    if (sub == "retrain") {
+        if (store->getSearchIndex() != VectorStore::SearchIndex::Ivf) {
+            std::cout << "Retrain applies to the ivf index; use /index ivf first.\n";
+            return;
+        }
+        indexManager->retrainIvf();
+        snap = indexManager->snapshot();
+        store = &snap->store;
+        std::cout << "IVF retrained: " << store->ivfLists() << " lists over "
+                  << store->liveSize() << " rows\n";
+        return;
+    }
+
+    if (sub == "flat" || sub == "hnsw" || sub == "ivf" || sub == "binary") {
+        if (!config) {
+            std::cout << "No config connected.\n";
+            return;
+        }
+        config->set("ann_index", sub);
+        indexManager->applyConfig(*config);
+        std::cout << "Search index set to " << sub << "\n";
+        return;
+    }
+
+    if (sub == "recall") {
+        size_t queries = 100;
+        iss >> queries;
+        auto start = std::chrono::steady_clock::now();
+        double recall = store->measureRecall(queries, DEFAULT_RAG_TOP_K);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start).count();
+        std::cout << "Recall@" << DEFAULT_RAG_TOP_K << " vs exact scan: " << recall
+                  << " (" << std::min(queries, store->size()) << " queries, " << ms << " ms)\n";
+        return;
+    }
+
+    std::cout << "Unknown index option: " << sub << "\n";
+}
 
 std::string CommandProcessor::processQuery(const std::string& input) {
     ensureInitialized();
@@ -162,6 +238,7 @@ void CommandProcessor::setConfig(const std::string& key, const std::string& valu
     if (config) {
         if (config->set(key, value)) {
             std::cout << "Updated " << key << " to " << value << "\n";
+            indexManager->applyConfig(*config);
         } else {
             std::cout << "Failed to update key: " << key << "\n";
         }
@@ -195,8 +272,10 @@ void CommandProcessor::handleCommand(const std::string& input) {
         if (key.empty() || value.empty()) {
             std::cout << "Usage: /set <key> <value>\n";
         } else if (config) {
-            if(config->set(key, value))
+            if(config->set(key, value)) {
                 std::cout << "Updated " << key << " to " << value << "\n";
+                indexManager->applyConfig(*config);
+            }
             else
                 std::cout << "Failed to update key: " << key << "\n";
         } else {
@@ -237,10 +316,13 @@ void CommandProcessor::showHelp() {
         "Built-ins:\n"
         "  /help               Show this help\n"
         "  /rag                Query knowledge with RAG\n"
+        "                      (--path <dir> --ext <.h,.cpp> --symbol <name> narrow it)\n"
         "  /clear              Clears agent's memory and summaries\n"
         "  /backend ollama     Switch to Ollama\n"
         "  /backend openai     Switch to OpenAI\n"
         "  /similarity         Switch Similarity\n"
+        "  /index flat|hnsw|ivf|binary  Switch search index; /index retrain reruns IVF k-means,\n"
+        "                      /index recall [n] measures ANN recall\n"
         "  /config             Show config values"
         "  /set temerature     0.5 etc less than 1\n"
         "Also: type 'exit' or 'quit' to leave.\n";
@@ -255,6 +337,7 @@ void CommandProcessor::clearMemory() {
 void CommandProcessor::ensureInitialized() {
     if (!initialized) {
         FileHandler fh;
+        if (config) indexManager->applyConfig(*config);
         indexManager->init(fh.getRagDirectory());
         
         indexManager->indexProject(fh.getRagDirectory());
@@ -275,17 +358,47 @@ void CommandProcessor::initializeCommands() {
     commandHandlers["similarity"] = [this](const std::string& args) {
     handleSimilarityCommand(args); };
     commandHandlers["config"] = [this](const std::string&) { showConfig(); };
+    commandHandlers["index"] = [this](const std::string& args) { handleIndexCommand(args); };
 
 
 }
 
 void CommandProcessor::handleRag(const std::string& args) {
-    if (args.empty()) {
-        std::cout << "Usage: /rag <your query>\n";
+    // Leading options narrow the search: --path <dir> --ext <.h,.cpp> --symbol <name>
+    SearchFilter filter;
+    std::istringstream iss(args);
+    std::string token, query;
+    while (iss >> token) {
+        std::string value;
+        if ((token == "--path" || token == "--ext" || token == "--symbol") && iss >> value) {
+            if (token == "--path") {
+                FileHandler fh;
+                fs::path p(value);
+                if (p.is_relative()) p = fs::path(fh.getRagDirectory()) / p;
+                filter.pathPrefix = fs::absolute(p).lexically_normal().string();
+            } else if (token == "--ext") {
+                std::istringstream exts(value);
+                std::string ext;
+                while (std::getline(exts, ext, ',')) {
+                    if (ext.empty()) continue;
+                    filter.extensions.push_back(ext[0] == '.' ? ext : "." + ext);
+                }
+            } else {
+                filter.symbol = value;
+            }
+            continue;
+        }
+        std::getline(iss, query);
+        query = token + query;
+        break;
+    }
+
+    if (query.empty()) {
+        std::cout << "Usage: /rag [--path <dir>] [--ext <.h,.cpp>] [--symbol <name>] <your query>\n";
         return;
     }
 
-    auto chunks = rag.retrieveRelevant(args, {}, 5); // top 5
+    auto chunks = rag.retrieveRelevant(query, {}, 5, filter); // top 5
     if (chunks.empty()) {
         std::cout << "[RAG] No relevant context found.\n";
         return;
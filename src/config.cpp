@@ -11,7 +11,7 @@ Config::Config()
       top_p(1.0),
       max_tokens(512),
       max_results(5),            // default topK for RAG
-      similarity_threshold(0.7)  // optional
+      similarity_threshold(0.01) // min retrieval score (metric units)
 {}
 
 bool Config::loadFromJson(const std::string& path) {
@@ -28,9 +28,22 @@ bool Config::loadFromJson(const std::string& path) {
     if (j.contains("verbosity")) verbosity = j["verbosity"];
     if (j.contains("max_retries")) max_retries = j["max_retries"];
     if (j.contains("memory_limit_mb")) memory_limit_mb = j["memory_limit_mb"];
+    if (j.contains("eviction_policy")) eviction_policy = j["eviction_policy"];
     if (j.contains("disk_quota_mb")) disk_quota_mb = j["disk_quota_mb"];
     if (j.contains("allow_web")) allow_web = j["allow_web"];
     if (j.contains("allow_file_io")) allow_file_io = j["allow_file_io"];
+    if (j.contains("ann_index")) ann_index = j["ann_index"];
+    if (j.contains("hnsw_m")) hnsw_m = j["hnsw_m"];
+    if (j.contains("hnsw_ef_construction")) hnsw_ef_construction = j["hnsw_ef_construction"];
+    if (j.contains("hnsw_ef_search")) hnsw_ef_search = j["hnsw_ef_search"];
+    if (j.contains("ivf_nlist")) ivf_nlist = j["ivf_nlist"];
+    if (j.contains("ivf_nprobe")) ivf_nprobe = j["ivf_nprobe"];
+    if (j.contains("binary_candidates")) binary_candidates = j["binary_candidates"];
+    if (j.contains("embedding_storage")) embedding_storage = j["embedding_storage"];
+    if (j.contains("search_threads")) search_threads = j["search_threads"];
+    if (j.contains("retrieval_mode")) retrieval_mode = j["retrieval_mode"];
+    if (j.contains("mmr_lambda")) mmr_lambda = j["mmr_lambda"];
+    if (j.contains("similarity_threshold")) similarity_threshold = j["similarity_threshold"];
 
     return true;
 }
@@ -45,9 +58,22 @@ bool Config::saveToJson(const std::string& path) const {
     j["verbosity"] = verbosity;
     j["max_retries"] = max_retries;
     j["memory_limit_mb"] = memory_limit_mb;
+    j["eviction_policy"] = eviction_policy;
     j["disk_quota_mb"] = disk_quota_mb;
     j["allow_web"] = allow_web;
     j["allow_file_io"] = allow_file_io;
+    j["ann_index"] = ann_index;
+    j["hnsw_m"] = hnsw_m;
+    j["hnsw_ef_construction"] = hnsw_ef_construction;
+    j["hnsw_ef_search"] = hnsw_ef_search;
+    j["ivf_nlist"] = ivf_nlist;
+    j["ivf_nprobe"] = ivf_nprobe;
+    j["binary_candidates"] = binary_candidates;
+    j["embedding_storage"] = embedding_storage;
+    j["search_threads"] = search_threads;
+    j["retrieval_mode"] = retrieval_mode;
+    j["mmr_lambda"] = mmr_lambda;
+    j["similarity_threshold"] = similarity_threshold;
 
     std::ofstream file(path);
     if (!file.is_open()) return false;
@@ -63,9 +89,22 @@ std::string Config::get(const std::string& key) const {
     if (key == "verbosity") return std::to_string(verbosity);
     if (key == "max_retries") return std::to_string(max_retries);
     if (key == "memory_limit_mb") return std::to_string(memory_limit_mb);
+    if (key == "eviction_policy") return eviction_policy;
     if (key == "disk_quota_mb") return std::to_string(disk_quota_mb);
     if (key == "allow_web") return allow_web ? "true" : "false";
     if (key == "allow_file_io") return allow_file_io ? "true" : "false";
+    if (key == "ann_index") return ann_index;
+    if (key == "hnsw_m") return std::to_string(hnsw_m);
+    if (key == "hnsw_ef_construction") return std::to_string(hnsw_ef_construction);
+    if (key == "hnsw_ef_search") return std::to_string(hnsw_ef_search);
+    if (key == "ivf_nlist") return std::to_string(ivf_nlist);
+    if (key == "ivf_nprobe") return std::to_string(ivf_nprobe);
+    if (key == "binary_candidates") return std::to_string(binary_candidates);
+    if (key == "embedding_storage") return embedding_storage;
+    if (key == "search_threads") return std::to_string(search_threads);
+    if (key == "retrieval_mode") return retrieval_mode;
+    if (key == "mmr_lambda") return std::to_string(mmr_lambda);
+    if (key == "similarity_threshold") return std::to_string(similarity_threshold);
     return "<unknown>";
 }
 
@@ -78,9 +117,38 @@ bool Config::set(const std::string& key, const std::string& value) {
         else if (key == "verbosity") verbosity = std::stoi(value);
         else if (key == "max_retries") max_retries = std::stoi(value);
         else if (key == "memory_limit_mb") memory_limit_mb = std::stoul(value);
+        else if (key == "eviction_policy") {
+            if (value != "lru" && value != "lfu") return false;
+            eviction_policy = value;
+        }
         else if (key == "disk_quota_mb") disk_quota_mb = std::stoul(value);
         else if (key == "allow_web") allow_web = (value == "true");
         else if (key == "allow_file_io") allow_file_io = (value == "true");
+        else if (key == "ann_index") {
+            if (value != "flat" && value != "hnsw" && value != "ivf" && value != "binary") return false;
+            ann_index = value;
+        }
+        else if (key == "hnsw_m") hnsw_m = std::stoul(value);
+        else if (key == "hnsw_ef_construction") hnsw_ef_construction = std::stoul(value);
+        else if (key == "hnsw_ef_search") hnsw_ef_search = std::stoul(value);
+        else if (key == "ivf_nlist") ivf_nlist = std::stoul(value);
+        else if (key == "ivf_nprobe") ivf_nprobe = std::stoul(value);
+        else if (key == "binary_candidates") binary_candidates = std::stoul(value);
+        else if (key == "embedding_storage") {
+            if (value != "float32" && value != "fp16" && value != "bf16" && value != "int8") return false;
+            embedding_storage = value;
+        }
+        else if (key == "search_threads") search_threads = std::stoul(value);
+        else if (key == "retrieval_mode") {
+            if (value != "topk" && value != "mmr") return false;
+            retrieval_mode = value;
+        }
+        else if (key == "mmr_lambda") {
+            double lambda = std::stod(value);
+            if (lambda < 0.0 || lambda > 1.0) return false;
+            mmr_lambda = lambda;
+        }
+        else if (key == "similarity_threshold") similarity_threshold = std::stod(value);
         else return false;
     } catch (...) {
         return false;
@@ -97,8 +165,21 @@ void Config::printConfig() const {
     std::cout << "verbosity       : " << verbosity << "\n";
     std::cout << "max_retries     : " << max_retries << "\n";
     std::cout << "memory_limit_mb : " << memory_limit_mb << "\n";
+    std::cout << "eviction_policy : " << eviction_policy << "\n";
     std::cout << "disk_quota_mb   : " << disk_quota_mb << "\n";
     std::cout << "allow_web       : " << (allow_web ? "true" : "false") << "\n";
     std::cout << "allow_file_io   : " << (allow_file_io ? "true" : "false") << "\n";
+    std::cout << "ann_index       : " << ann_index << "\n";
+    std::cout << "hnsw_m          : " << hnsw_m << "\n";
+    std::cout << "hnsw_ef_construction : " << hnsw_ef_construction << "\n";
+    std::cout << "hnsw_ef_search  : " << hnsw_ef_search << "\n";
+    std::cout << "ivf_nlist       : " << ivf_nlist << "\n";
+    std::cout << "ivf_nprobe      : " << ivf_nprobe << "\n";
+    std::cout << "binary_candidates : " << binary_candidates << "\n";
+    std::cout << "embedding_storage : " << embedding_storage << "\n";
+    std::cout << "search_threads  : " << search_threads << "\n";
+    std::cout << "retrieval_mode  : " << retrieval_mode << "\n";
+    std::cout << "mmr_lambda      : " << mmr_lambda << "\n";
+    std::cout << "similarity_threshold : " << similarity_threshold << "\n";
 }
 
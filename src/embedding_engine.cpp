@@ -9,25 +9,103 @@
 EmbeddingEngine::EmbeddingEngine(Method method) : method(method) {}
 
 void EmbeddingEngine::setMethod(Method m) {
+    std::unique_lock lock(stateMutex);
     method = m;
 }
 
+// ------------------------------------------------------------------
+// Fitting: the only writers of the TF-IDF corpus statistics
+// ------------------------------------------------------------------
+void EmbeddingEngine::fit(const std::vector<std::string>& corpus) {
+    std::vector<std::string_view> texts(corpus.begin(), corpus.end());
+    std::unique_lock lock(stateMutex);
+    // A new corpus is tokenized the current way
+    splitIdentifiers = true;
+    fitLocked(texts);
+}
+
+void EmbeddingEngine::refit(const std::vector<std::string_view>& corpus) {
+    std::unique_lock lock(stateMutex);
+    fitLocked(corpus);
+}
+
+void EmbeddingEngine::fitLocked(const std::vector<std::string_view>& corpus) {
+    documentCount = 0;
+    vocabulary.clear();
+    documentFreq.clear();
+    termBuckets.clear();
+    if (method != Method::TfIdf) return;
+
+    TermCounts counts;
+    for (std::string_view text : corpus) {
+        countTerms(text, splitIdentifiers, counts);
+        updateVocabulary(counts);
+    }
+}
+
+void EmbeddingEngine::partialFit(const std::string& text) {
+    // Tokenize before taking the lock so queries are held up only by the merge
+    thread_local TermCounts counts;
+    bool split = splitIdentifiers;
+    countTerms(text, split, counts);
+
+    std::unique_lock lock(stateMutex);
+    if (method != Method::TfIdf) return;
+    // A load or fit in between may have switched the tokenizer mode
+    if (split != splitIdentifiers) countTerms(text, splitIdentifiers, counts);
+    updateVocabulary(counts);
+}
+
+// Exact inverse of partialFit(text): terms keep their ids, and one whose
+// document frequency drops to 0 gets no weight, like a term never seen
+void EmbeddingEngine::unfit(const std::string& text) {
+    thread_local TermCounts counts;
+    bool split = splitIdentifiers;
+    countTerms(text, split, counts);
+
+    std::unique_lock lock(stateMutex);
+    if (method != Method::TfIdf || documentCount == 0) return;
+    if (split != splitIdentifiers) countTerms(text, splitIdentifiers, counts);
+    for (uint32_t t = 0; t < counts.terms.size(); ++t) {
+        uint32_t id = vocabulary.find(counts.terms.term(t));
+        if (id != TermDictionary::NO_TERM && documentFreq[id] > 0) --documentFreq[id];
+    }
+    --documentCount;
+}
+
+bool EmbeddingEngine::coversDocuments(size_t count) const {
+    std::shared_lock lock(stateMutex);
+    return method != Method::TfIdf || documentCount == count;
+}
+
 // ------------------------------------------------------------------
 // Public API: central entrypoint for all callers
 // ------------------------------------------------------------------
-std::vector<float> EmbeddingEngine::embed(const std::string& text) {
+std::vector<float> EmbeddingEngine::embed(const std::string& text) const {
+    std::shared_lock lock(stateMutex);
+    return embedDense(text);
+}
+
+SparseVector EmbeddingEngine::embedSparse(const std::string& text) const {
+    std::shared_lock lock(stateMutex);
+    if (producesSparse()) return embedSparseTerms(text);
+    // Dense methods: embedDense() already validates and normalizes
+    return SparseVector::fromDense(embedDense(text));
+}
+
+std::vector<float> EmbeddingEngine::embedDense(const std::string& text) const {
+    // Bag-of-terms methods are built sparse; densify for dense callers
+    if (producesSparse()) {
+        SparseVector sparse = embedSparseTerms(text);
+        return sparse.empty() ? std::vector<float>{} : sparse.toDense();
+    }
+
     std::vector<float> vec;
 
     switch (method) {
         case Method::Simple:
             vec = embedSimple(text);
             break;
-        case Method::TfIdf:
-            vec = embedTfIdf(text);
-            break;
-        case Method::WordHash:
-            vec = embedWordHash(text);
-            break;
         case Method::External:
             vec = embedExternal(text);
             break;
@@ -55,10 +133,24 @@ std::vector<float> EmbeddingEngine::embed(const std::string& text) {
     return normalizeVector(std::move(vec));
 }
 
+SparseVector EmbeddingEngine::embedSparseTerms(const std::string& text) const {
+    SparseVector vec = method == Method::TfIdf ? embedTfIdf(text) : embedWordHash(text);
+
+    for (size_t k = 0; k < vec.values.size(); ++k) {
+        if (!std::isfinite(vec.values[k])) {
+            std::cerr << "[EmbeddingEngine] Warning: non-finite embedding value at index "
+                      << vec.indices[k] << " (text length=" << text.size() << ")\n";
+            return {};
+        }
+    }
+
+    return normalizeVector(std::move(vec));
+}
+
 // ------------------------------------------------------------------
 // Embedding implementations (produce raw vectors only)
 // ------------------------------------------------------------------
-std::vector<float> EmbeddingEngine::embedSimple(const std::string& text) {
+std::vector<float> EmbeddingEngine::embedSimple(const std::string& text) const {
     // Simple per-character counts (raw)
     std::vector<float> vec;
     vec.reserve(text.size());
@@ -68,35 +160,54 @@ std::vector<float> EmbeddingEngine::embedSimple(const std::string& text) {
     return vec;
 }
 
-std::vector<float> EmbeddingEngine::embedTfIdf(const std::string& text) {
-    // Update vocabulary/state for TF-IDF (keeps corpus stats)
-    updateVocabulary(text);
+SparseVector EmbeddingEngine::embedTfIdf(const std::string& text) const {
+    // Reused per thread so repeated calls keep the table's buckets
+    thread_local TermCounts counts;
+    size_t total = countTerms(text, splitIdentifiers, counts);
+
+    // Bucket -> TF-IDF weight (VOCAB_SIZE buckets, few of them touched)
+    std::unordered_map<uint32_t, float> weights;
+    weights.reserve(counts.terms.size());
+    for (uint32_t t = 0; t < counts.terms.size(); ++t) {
+        // Terms never fitted have no IDF, so no weight
+        uint32_t id = vocabulary.find(counts.terms.term(t));
+        if (id == TermDictionary::NO_TERM) continue;
+        float tf = counts.counts[t] / static_cast<float>(total);
+        weights[termBuckets[id]] += tf * calculateIdf(id);
+    }
 
-    // Create TF-IDF-like vector (VOCAB_SIZE may be large)
-    std::vector<float> vec(VOCAB_SIZE, 0.0f);
-    auto tokens = tokenize(text);
-    if (tokens.empty()) return vec;
+    return fromTermWeights(weights); // raw
+}
 
-    // Compute term frequencies in this document
-    for (const auto& t : tokens) {
-        size_t idx = hashToIndex(t);
-        float tf = std::count(tokens.begin(), tokens.end(), t) / static_cast<float>(tokens.size());
-        vec[idx] = tf * calculateIdf(t);
+SparseVector EmbeddingEngine::embedWordHash(const std::string& text) const {
+    thread_local TermCounts counts;
+    countTerms(text, splitIdentifiers, counts);
+    std::unordered_map<uint32_t, float> weights;
+    weights.reserve(counts.terms.size());
+    for (uint32_t t = 0; t < counts.terms.size(); ++t) {
+        weights[hashToIndex(counts.terms.term(t))] += static_cast<float>(counts.counts[t]);
     }
-
-    return vec; // raw
+    return fromTermWeights(weights); // raw
 }
 
-std::vector<float> EmbeddingEngine::embedWordHash(const std::string& text) {
-    auto tokens = tokenize(text);
-    std::vector<float> vec(VOCAB_SIZE, 0.0f);
-    for (const auto& t : tokens) {
-        vec[hashToIndex(t)] += 1.0f;
+// Sorts bucket weights into a SparseVector, dropping zero weights
+SparseVector EmbeddingEngine::fromTermWeights(const std::unordered_map<uint32_t, float>& weights) {
+    std::vector<std::pair<uint32_t, float>> entries(weights.begin(), weights.end());
+    std::sort(entries.begin(), entries.end());
+
+    SparseVector vec;
+    vec.dimension = VOCAB_SIZE;
+    vec.indices.reserve(entries.size());
+    vec.values.reserve(entries.size());
+    for (const auto& [idx, w] : entries) {
+        if (w == 0.0f) continue;
+        vec.indices.push_back(idx);
+        vec.values.push_back(w);
     }
-    return vec; // raw
+    return vec;
 }
 
-std::vector<float> EmbeddingEngine::embedExternal(const std::string& text) {
+std::vector<float> EmbeddingEngine::embedExternal(const std::string& text) const {
     // Placeholder for external provider call. Return a raw vector.
     // For now use a simple fallback so callers still get a non-empty vector.
     std::vector<float> vec;
@@ -116,39 +227,48 @@ std::vector<float> EmbeddingEngine::embedExternal(const std::string& text) {
 // ------------------------------------------------------------------
 // Tokenization / helpers
 // ------------------------------------------------------------------
-std::vector<std::string> EmbeddingEngine::tokenize(const std::string& text) const {
-    std::vector<std::string> tokens;
-    std::string token;
-    for (char c : text) {
-        if (std::isalnum(static_cast<unsigned char>(c))) {
-            token += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-        } else if (!token.empty()) {
-            tokens.push_back(token);
-            token.clear();
-        }
-    }
-    if (!token.empty()) tokens.push_back(token);
-    return tokens;
+uint32_t EmbeddingEngine::hashToIndex(std::string_view term) {
+    // Same value as std::hash<std::string>, so stored indexes keep their buckets
+    return static_cast<uint32_t>(std::hash<std::string_view>{}(term) % VOCAB_SIZE);
 }
 
-size_t EmbeddingEngine::hashToIndex(const std::string& term) const {
-    return std::hash<std::string>{}(term) % VOCAB_SIZE;
+float EmbeddingEngine::calculateIdf(uint32_t id) const {
+    if (documentFreq[id] == 0) return 0.0f;
+    return std::log(static_cast<float>(documentCount) / static_cast<float>(1 + documentFreq[id]));
 }
 
-float EmbeddingEngine::calculateIdf(const std::string& term) const {
-    auto it = documentFreq.find(term);
-    if (it == documentFreq.end() || it->second == 0) return 0.0f;
-    return std::log(static_cast<float>(documents.size()) / static_cast<float>(1 + it->second));
+size_t EmbeddingEngine::countTerms(std::string_view text, bool split, TermCounts& counts) {
+    // Both tables keep their capacity, so counting a text allocates nothing
+    // once they have grown to the largest text seen on this thread
+    thread_local Tokenizer tokenizer;
+    tokenizer.setSplitIdentifiers(split);
+    tokenizer.reset(text);
+
+    counts.terms.clear();
+    counts.counts.clear();
+    size_t total = 0;
+    std::string_view term;
+    while (tokenizer.next(term)) {
+        uint32_t id = counts.terms.intern(term);
+        if (id == counts.counts.size()) counts.counts.push_back(0);
+        ++counts.counts[id];
+        ++total;
+    }
+    return total;
 }
 
-void EmbeddingEngine::updateVocabulary(const std::string& text) {
-    auto tokens = tokenize(text);
-    // Update corpus statistics
-    for (const auto& t : tokens) {
-        globalTermFreq[t] += 1.0f;
-        documentFreq[t] += 1;
+void EmbeddingEngine::updateVocabulary(const TermCounts& counts) {
+    // A term counts once toward its document frequency however often it occurs
+    for (uint32_t t = 0; t < counts.terms.size(); ++t) {
+        std::string_view term = counts.terms.term(t);
+        uint32_t id = vocabulary.intern(term);
+        if (id == documentFreq.size()) {
+            documentFreq.push_back(0);
+            termBuckets.push_back(hashToIndex(term));
+        }
+        documentFreq[id] += 1;
     }
-    documents.push_back(text);  // add document to corpus
+    ++documentCount;
 }
 
 // ------------------------------------------------------------------
@@ -166,111 +286,126 @@ std::vector<float> EmbeddingEngine::normalizeVector(std::vector<float> vec) cons
     return vec;
 }
 
+SparseVector EmbeddingEngine::normalizeVector(SparseVector vec) const {
+    float norm = std::sqrt(vec.squaredNorm());
+    if (norm > 0.0f) {
+        for (auto& v : vec.values) v /= norm;
+    } else {
+        std::cerr << "[EmbeddingEngine] Warning: zero-norm embedding encountered during normalization\n";
+    }
+    return vec;
+}
+
+// ------------------------------------------------------------------
+// Persistence: method, tokenizer mode, document count, vocabulary and
+// per-term statistics
 // ------------------------------------------------------------------
-// Persistence (unchanged, preserved)
- // ------------------------------------------------------------------
 bool EmbeddingEngine::saveState(const std::string& filepath) const {
+    std::shared_lock lock(stateMutex);
     try {
         std::ofstream out(filepath, std::ios::binary);
         if (!out) return false;
 
+        out.write(reinterpret_cast<const char*>(&STATE_MAGIC), sizeof(STATE_MAGIC));
+        out.write(reinterpret_cast<const char*>(&STATE_VERSION), sizeof(STATE_VERSION));
+
         // Save method
         int methodInt = static_cast<int>(method);
         out.write(reinterpret_cast<const char*>(&methodInt), sizeof(methodInt));
+        uint8_t split = splitIdentifiers ? 1 : 0;
+        out.write(reinterpret_cast<const char*>(&split), sizeof(split));
 
-        // Save documents
-        size_t numDocs = documents.size();
-        out.write(reinterpret_cast<const char*>(&numDocs), sizeof(numDocs));
-        for (const auto& doc : documents) {
-            size_t len = doc.size();
-            out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-            out.write(doc.data(), len);
-        }
-
-        // Save globalTermFreq
-        size_t gtfSize = globalTermFreq.size();
-        out.write(reinterpret_cast<const char*>(&gtfSize), sizeof(gtfSize));
-        for (const auto& kv : globalTermFreq) {
-            const std::string& term = kv.first;
-            float freq = kv.second;
-            size_t len = term.size();
-            out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-            out.write(term.data(), len);
-            out.write(reinterpret_cast<const char*>(&freq), sizeof(freq));
-        }
-
-        // Save documentFreq
-        size_t dfSize = documentFreq.size();
-        out.write(reinterpret_cast<const char*>(&dfSize), sizeof(dfSize));
-        for (const auto& kv : documentFreq) {
-            const std::string& term = kv.first;
-            size_t count = kv.second;
-            size_t len = term.size();
-            out.write(reinterpret_cast<const char*>(&len), sizeof(len));
-            out.write(term.data(), len);
-            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
-        }
+        out.write(reinterpret_cast<const char*>(&documentCount), sizeof(documentCount));
+        vocabulary.write(out);
+        out.write(reinterpret_cast<const char*>(documentFreq.data()), documentFreq.size() * sizeof(uint32_t));
 
-        return true;
+        return static_cast<bool>(out);
     } catch (...) {
         return false;
     }
 }
 
 bool EmbeddingEngine::loadState(const std::string& filepath) {
+    std::unique_lock lock(stateMutex);
     try {
         std::ifstream in(filepath, std::ios::binary);
         if (!in) return false;
 
-        documents.clear();
-        globalTermFreq.clear();
+        documentCount = 0;
+        vocabulary.clear();
         documentFreq.clear();
+        termBuckets.clear();
 
-        // Load method
+        // States before version 1 have no header and open with the method
+        uint32_t magic = 0;
+        in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        uint32_t version = 0;
         int methodInt = 0;
-        in.read(reinterpret_cast<char*>(&methodInt), sizeof(methodInt));
+        if (magic != STATE_MAGIC) {
+            methodInt = static_cast<int>(magic);
+        } else {
+            in.read(reinterpret_cast<char*>(&version), sizeof(version));
+            if (version == 0 || version > STATE_VERSION) {
+                std::cerr << "[EmbeddingEngine] Unsupported state version " << version << "\n";
+                return false;
+            }
+            in.read(reinterpret_cast<char*>(&methodInt), sizeof(methodInt));
+        }
         method = static_cast<Method>(methodInt);
 
-        // Load documents
-        size_t numDocs = 0;
-        in.read(reinterpret_cast<char*>(&numDocs), sizeof(numDocs));
-        for (size_t i = 0; i < numDocs; ++i) {
-            size_t len = 0;
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            std::string doc(len, '\0');
-            in.read(&doc[0], len);
-            documents.push_back(std::move(doc));
+        // Before version 3 every run of letters and digits was one term
+        uint8_t split = 0;
+        if (version >= 3) in.read(reinterpret_cast<char*>(&split), sizeof(split));
+        splitIdentifiers = split != 0;
+
+        in.read(reinterpret_cast<char*>(&documentCount), sizeof(documentCount));
+        if (version == 0) {
+            // Only the count was ever used; skip the stored texts
+            for (size_t i = 0; i < documentCount && in; ++i) {
+                size_t len = 0;
+                in.read(reinterpret_cast<char*>(&len), sizeof(len));
+                in.seekg(static_cast<std::streamoff>(len), std::ios::cur);
+            }
         }
 
-        // Load globalTermFreq
-        size_t gtfSize = 0;
-        in.read(reinterpret_cast<char*>(&gtfSize), sizeof(gtfSize));
-        for (size_t i = 0; i < gtfSize; ++i) {
-            size_t len = 0;
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            std::string term(len, '\0');
-            in.read(&term[0], len);
-            float freq;
-            in.read(reinterpret_cast<char*>(&freq), sizeof(freq));
-            globalTermFreq[std::move(term)] = freq;
+        if (version >= 2) {
+            if (!vocabulary.read(in)) return false;
+            // Versions 2 and 3 stored per-term corpus counts, which nothing used
+            if (version < 4) {
+                in.seekg(static_cast<std::streamoff>(vocabulary.size() * sizeof(uint32_t)), std::ios::cur);
+            }
+            documentFreq.resize(vocabulary.size());
+            in.read(reinterpret_cast<char*>(documentFreq.data()), documentFreq.size() * sizeof(uint32_t));
+        } else {
+            // Versions 0 and 1 keep two string-keyed tables: term -> float
+            // corpus frequency (unused, skipped), then term -> size_t
+            // document frequency
+            auto readTable = [&](auto value, auto store) {
+                size_t entries = 0;
+                in.read(reinterpret_cast<char*>(&entries), sizeof(entries));
+                std::string term;
+                for (size_t i = 0; i < entries && in; ++i) {
+                    size_t len = 0;
+                    in.read(reinterpret_cast<char*>(&len), sizeof(len));
+                    term.resize(len);
+                    in.read(&term[0], len);
+                    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+                    store(term, value);
+                }
+            };
+            readTable(0.0f, [](const std::string&, float) {});
+            readTable(size_t{ 0 }, [&](const std::string& term, size_t count) {
+                uint32_t id = vocabulary.intern(term);
+                documentFreq.resize(vocabulary.size());
+                documentFreq[id] = static_cast<uint32_t>(count);
+            });
         }
 
-        // Load documentFreq
-        size_t dfSize = 0;
-        in.read(reinterpret_cast<char*>(&dfSize), sizeof(dfSize));
-        for (size_t i = 0; i < dfSize; ++i) {
-            size_t len = 0;
-            in.read(reinterpret_cast<char*>(&len), sizeof(len));
-            std::string term(len, '\0');
-            in.read(&term[0], len);
-            size_t count;
-            in.read(reinterpret_cast<char*>(&count), sizeof(count));
-            documentFreq[std::move(term)] = count;
-        }
+        termBuckets.resize(vocabulary.size());
+        for (uint32_t id = 0; id < vocabulary.size(); ++id) termBuckets[id] = hashToIndex(vocabulary.term(id));
 
-        return true;
+        return static_cast<bool>(in);
     } catch (...) {
         return false;
     }
 }
-
@@ -0,0 +1,70 @@
+#include "../include/embedding_matrix.h"
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+// ------------------------------------------------------------------
+// Shape
+// ------------------------------------------------------------------
+bool EmbeddingMatrix::setDimension(size_t dim) {
+    if (rows() > 0 && dim != dimension) return false;
+    if (dim == dimension && rowStride != 0) return true;
+
+    dimension = dim;
+    rowStride = (dim + FLOATS_PER_LINE - 1) / FLOATS_PER_LINE * FLOATS_PER_LINE;
+    buffer = SharedRows<float>(rowStride);
+    return true;
+}
+
+size_t EmbeddingMatrix::appendRow(RowView values) {
+    buffer.appendRow();
+    setRow(rows() - 1, values);
+    return rows() - 1;
+}
+
+void EmbeddingMatrix::setRow(size_t i, RowView values) {
+    float* dst = buffer.mutableRow(i);
+    size_t n = std::min(values.size(), dimension);
+    if (n > 0) std::memcpy(dst, values.data(), n * sizeof(float));
+    // Zero the tail (short rows and stride padding) so kernels may read the full stride
+    std::fill(dst + n, dst + rowStride, 0.0f);
+}
+
+void EmbeddingMatrix::keepRows(const std::vector<uint8_t>& keep) {
+    buffer.keepRows(keep);
+}
+
+void EmbeddingMatrix::clear() {
+    buffer.clear();
+}
+
+// ------------------------------------------------------------------
+// Persistence
+// ------------------------------------------------------------------
+bool EmbeddingMatrix::write(std::ostream& out) const {
+    size_t rowCount = rows();
+    out.write(reinterpret_cast<const char*>(&rowCount), sizeof(rowCount));
+    out.write(reinterpret_cast<const char*>(&dimension), sizeof(dimension));
+    out.write(reinterpret_cast<const char*>(&rowStride), sizeof(rowStride));
+    return buffer.writeRows(out);
+}
+
+bool EmbeddingMatrix::read(std::istream& in) {
+    size_t rowCount = 0, dim = 0, strideOnDisk = 0;
+    in.read(reinterpret_cast<char*>(&rowCount), sizeof(rowCount));
+    in.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+    in.read(reinterpret_cast<char*>(&strideOnDisk), sizeof(strideOnDisk));
+    if (!in) return false;
+
+    clear();
+    dimension = 0;
+    setDimension(dim);
+    if (strideOnDisk != rowStride) return false;
+
+    if (!buffer.readRows(in, rowCount)) {
+        clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,310 @@
+#include "../include/hnsw_index.h"
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <ostream>
+#include <queue>
+
+namespace {
+
+// Per-thread visited marks; bumping the generation clears them in O(1)
+struct VisitedSet {
+    std::vector<uint32_t> marks;
+    uint32_t generation = 0;
+
+    void reset(size_t n) {
+        if (marks.size() < n) marks.resize(n, 0);
+        if (++generation == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            generation = 1;
+        }
+    }
+    bool insert(uint32_t id) {
+        if (marks[id] == generation) return false;
+        marks[id] = generation;
+        return true;
+    }
+};
+
+thread_local VisitedSet visited;
+
+struct BetterFirst {
+    bool operator()(const SearchHit& a, const SearchHit& b) const { return a.score < b.score; }
+};
+struct WorseFirst {
+    bool operator()(const SearchHit& a, const SearchHit& b) const { return a.score > b.score; }
+};
+
+} // namespace
+
+// ------------------------------------------------------------------
+// Link storage
+// ------------------------------------------------------------------
+std::span<uint32_t> HnswIndex::linkSlot(uint32_t node, int level) {
+    if (level == 0) return { baseLinks.mutableRow(node), baseLinks.width() };
+    size_t stride = 1 + maxLinks(level);
+    return { upperLinks.mutableRow(node)->data() + (level - 1) * stride, stride };
+}
+
+std::span<const uint32_t> HnswIndex::links(uint32_t node, int level) const {
+    const uint32_t* slot = level == 0 ? baseLinks.row(node)
+                                      : upperLinks[node].data() + (level - 1) * (1 + maxLinks(level));
+    return { slot + 1, slot[0] };
+}
+
+void HnswIndex::setLinks(uint32_t node, int level, const std::vector<uint32_t>& ids) {
+    auto slot = linkSlot(node, level);
+    size_t n = std::min(ids.size(), slot.size() - 1);
+    slot[0] = static_cast<uint32_t>(n);
+    std::copy(ids.begin(), ids.begin() + n, slot.begin() + 1);
+}
+
+// ------------------------------------------------------------------
+// Parameters / lifecycle
+// ------------------------------------------------------------------
+void HnswIndex::setParams(const Params& params) {
+    settings.efSearch = std::max<size_t>(1, params.efSearch);
+    if (empty()) {
+        settings.M = std::max<size_t>(2, params.M);
+        settings.efConstruction = std::max<size_t>(1, params.efConstruction);
+    }
+}
+
+void HnswIndex::clear() {
+    levels.clear();
+    baseLinks.clear();
+    upperLinks.clear();
+    entryPoint = 0;
+    maxLevel = -1;
+    rng.seed(0x5eed);
+}
+
+int HnswIndex::randomLevel() {
+    // Geometric level distribution with mL = 1 / ln(M)
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double r = std::max(uniform(rng), 1e-12);
+    int level = static_cast<int>(-std::log(r) / std::log(static_cast<double>(settings.M)));
+    return std::min(level, MAX_LEVEL);
+}
+
+// ------------------------------------------------------------------
+// Search
+// ------------------------------------------------------------------
+std::vector<SearchHit> HnswIndex::searchLayer(const std::vector<SearchHit>& entries,
+                                              const QueryScore& score, size_t ef, int level,
+                                              const Accept& accept) const {
+    visited.reset(size());
+
+    std::priority_queue<SearchHit, std::vector<SearchHit>, BetterFirst> candidates;
+    std::priority_queue<SearchHit, std::vector<SearchHit>, WorseFirst> best;
+    auto keep = [&](const SearchHit& hit) {
+        if (accept && !accept(hit.doc)) return;
+        best.push(hit);
+        if (best.size() > ef) best.pop();
+    };
+
+    for (const auto& e : entries) {
+        if (!visited.insert(e.doc)) continue;
+        candidates.push(e);
+        keep(e);
+    }
+
+    while (!candidates.empty()) {
+        SearchHit current = candidates.top();
+        if (best.size() >= ef && current.score < best.top().score) break;
+        candidates.pop();
+
+        for (uint32_t neighbor : links(current.doc, level)) {
+            if (!visited.insert(neighbor)) continue;
+            float s = score(neighbor);
+            if (best.size() < ef || s > best.top().score) {
+                candidates.push({ neighbor, s });
+                keep({ neighbor, s });
+            }
+        }
+    }
+
+    std::vector<SearchHit> out;
+    out.reserve(best.size());
+    while (!best.empty()) {
+        out.push_back(best.top());
+        best.pop();
+    }
+    std::reverse(out.begin(), out.end());   // best first
+    return out;
+}
+
+std::vector<SearchHit> HnswIndex::search(const QueryScore& score, size_t topK,
+                                         const Accept& accept) const {
+    if (empty() || topK == 0) return {};
+
+    std::vector<SearchHit> entry{ { entryPoint, score(entryPoint) } };
+    for (int level = maxLevel; level > 0; --level) {
+        entry = searchLayer(entry, score, 1, level);
+    }
+
+    auto found = searchLayer(entry, score, std::max(settings.efSearch, topK), 0, accept);
+    TopK top(topK);
+    for (const auto& hit : found) top.offer(hit.doc, hit.score);
+    return top.take();
+}
+
+// ------------------------------------------------------------------
+// Insertion
+// ------------------------------------------------------------------
+
+// Diversity heuristic: keep a candidate only if it is closer to the new
+// node than to every neighbour already kept, then top up with the rest.
+std::vector<uint32_t> HnswIndex::selectNeighbors(const std::vector<SearchHit>& candidates,
+                                                 size_t maxCount, const PairScore& score) const {
+    std::vector<uint32_t> kept;
+    std::vector<uint32_t> skipped;
+    for (const auto& c : candidates) {
+        if (kept.size() >= maxCount) break;
+        bool diverse = std::all_of(kept.begin(), kept.end(),
+                                   [&](uint32_t k) { return score(c.doc, k) < c.score; });
+        (diverse ? kept : skipped).push_back(c.doc);
+    }
+    for (uint32_t s : skipped) {
+        if (kept.size() >= maxCount) break;
+        kept.push_back(s);
+    }
+    return kept;
+}
+
+void HnswIndex::insert(const PairScore& score) {
+    uint32_t node = static_cast<uint32_t>(size());
+    int level = randomLevel();
+
+    // Slots per node follow M, which may change while the graph is empty
+    if (node == 0) baseLinks = SharedRows<uint32_t>(1 + maxLinks(0), NODE_BLOCK_ROWS);
+    levels.push_back(static_cast<uint8_t>(level));
+    baseLinks.appendRow();
+    upperLinks.push_back(std::vector<uint32_t>(static_cast<size_t>(level) * (1 + settings.M), 0));
+
+    if (maxLevel < 0) {
+        entryPoint = node;
+        maxLevel = level;
+        return;
+    }
+
+    QueryScore toNode = [&](uint32_t other) { return score(node, other); };
+
+    std::vector<SearchHit> entry{ { entryPoint, toNode(entryPoint) } };
+    for (int l = maxLevel; l > level; --l) {
+        entry = searchLayer(entry, toNode, 1, l);
+    }
+
+    for (int l = std::min(level, maxLevel); l >= 0; --l) {
+        auto candidates = searchLayer(entry, toNode, settings.efConstruction, l);
+        auto neighbors = selectNeighbors(candidates, settings.M, score);
+        setLinks(node, l, neighbors);
+
+        // Back-links; shrink a neighbour's list with the same heuristic when it overflows
+        for (uint32_t n : neighbors) {
+            auto current = links(n, l);
+            std::vector<uint32_t> ids(current.begin(), current.end());
+            ids.push_back(node);
+            if (ids.size() > maxLinks(l)) {
+                std::vector<SearchHit> scored;
+                scored.reserve(ids.size());
+                for (uint32_t id : ids) scored.push_back({ id, score(n, id) });
+                std::sort(scored.begin(), scored.end(),
+                          [](const SearchHit& a, const SearchHit& b) { return a.score > b.score; });
+                ids = selectNeighbors(scored, maxLinks(l), score);
+            }
+            setLinks(n, l, ids);
+        }
+        entry = std::move(candidates);
+    }
+
+    if (level > maxLevel) {
+        entryPoint = node;
+        maxLevel = level;
+    }
+}
+
+// ------------------------------------------------------------------
+// Persistence
+// ------------------------------------------------------------------
+bool HnswIndex::write(std::ostream& out) const {
+    uint64_t header[5] = { settings.M, settings.efConstruction, settings.efSearch,
+                           size(), entryPoint };
+    int32_t level = maxLevel;
+    out.write(reinterpret_cast<const char*>(&FILE_MAGIC), sizeof(FILE_MAGIC));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&level), sizeof(level));
+    levels.writeRows(out);
+    baseLinks.writeRows(out);
+    for (const auto& l : upperLinks) {
+        out.write(reinterpret_cast<const char*>(l.data()), l.size() * sizeof(uint32_t));
+    }
+    return static_cast<bool>(out);
+}
+
+bool HnswIndex::read(std::istream& in) {
+    uint32_t magic = 0;
+    uint64_t header[5] = {};
+    int32_t level = -1;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    in.read(reinterpret_cast<char*>(&level), sizeof(level));
+    if (!in || magic != FILE_MAGIC || header[0] < 2 || header[0] > MAX_M
+        || header[3] >= UINT32_MAX) {
+        return false;
+    }
+
+    // A count the rest of the stream cannot hold is corrupt; checking it
+    // first keeps a bad header from sizing the allocations below
+    size_t count = header[3];
+    size_t baseBytes = count * (1 + (1 + 2 * header[0]) * sizeof(uint32_t));
+    std::streampos start = in.tellg();
+    if (start != std::streampos(-1) && in.seekg(0, std::ios::end)) {
+        std::streamoff left = in.tellg() - start;
+        in.seekg(start);
+        if (left < 0 || static_cast<uint64_t>(left) < baseBytes) return false;
+    }
+
+    clear();
+    settings.M = header[0];
+    settings.efConstruction = header[1];
+    settings.efSearch = header[2];
+
+    baseLinks = SharedRows<uint32_t>(1 + maxLinks(0), NODE_BLOCK_ROWS);
+    bool valid = levels.readRows(in, count) && baseLinks.readRows(in, count);
+    for (size_t i = 0; valid && i < count; ++i) {
+        valid = levels[i] <= MAX_LEVEL;
+        if (!valid) break;
+        std::vector<uint32_t> upper(static_cast<size_t>(levels[i]) * (1 + settings.M));
+        in.read(reinterpret_cast<char*>(upper.data()), upper.size() * sizeof(uint32_t));
+        upperLinks.push_back(std::move(upper));
+        valid = static_cast<bool>(in);
+    }
+
+    entryPoint = static_cast<uint32_t>(header[4]);
+    maxLevel = level;
+    if (!valid || !consistent()) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool HnswIndex::consistent() const {
+    if (empty()) return maxLevel == -1;
+    if (entryPoint >= size() || maxLevel != *std::max_element(levels.begin(), levels.end())
+        || levels[entryPoint] != maxLevel) {
+        return false;
+    }
+    for (uint32_t node = 0; node < size(); ++node) {
+        for (int l = 0; l <= levels[node]; ++l) {
+            auto ids = links(node, l);
+            if (ids.size() > maxLinks(l)) return false;
+            // A neighbour must exist on this layer for searchLayer to follow it
+            for (uint32_t id : ids) {
+                if (id >= size() || levels[id] < l) return false;
+            }
+        }
+    }
+    return true;
+}
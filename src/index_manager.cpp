@@ -1,10 +1,13 @@
 #include "../include/index_manager.h"
 #include "../include/file_handler.h"
+#include "../include/simd_kernels.h"
 #include <iostream>
 #include <algorithm>
 #include <filesystem>
+#include <string_view>
 #include <mutex>
 #include <fstream>
+#include <chrono>
 
 
 
@@ -35,6 +38,64 @@ static bool pathIsUnderDirectory(const std::string& pathStr, const std::string&
     }
 }
 
+// File modification time in seconds since epoch, 0 if unavailable
+static int64_t fileModifiedTime(const std::string& path) {
+    try {
+        auto sys = std::chrono::file_clock::to_sys(fs::last_write_time(path));
+        return std::chrono::duration_cast<std::chrono::seconds>(sys.time_since_epoch()).count();
+    } catch (...) {
+        return 0;
+    }
+}
+
+// Embedding values on disk: float32, or fp16/bf16 (half the bytes) when the
+// store keeps its rows at that precision
+enum class ValueFormat : uint8_t { Float32, Float16, BFloat16 };
+
+static ValueFormat valueFormatFor(VectorStore::Storage storage) {
+    if (storage == VectorStore::Storage::Float16) return ValueFormat::Float16;
+    if (storage == VectorStore::Storage::BFloat16) return ValueFormat::BFloat16;
+    return ValueFormat::Float32;
+}
+
+static void writeValues(std::ostream& out, const std::vector<float>& values, ValueFormat format) {
+    if (format == ValueFormat::Float32) {
+        out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+        return;
+    }
+    std::vector<uint16_t> half(values.size());
+    if (format == ValueFormat::Float16) {
+        SimdKernels::floatToHalf(values.data(), half.data(), values.size());
+    } else {
+        SimdKernels::floatToBf16(values.data(), half.data(), values.size());
+    }
+    out.write(reinterpret_cast<const char*>(half.data()), half.size() * sizeof(uint16_t));
+}
+
+static void readValues(std::istream& in, std::vector<float>& values, ValueFormat format) {
+    if (format == ValueFormat::Float32) {
+        in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+        return;
+    }
+    std::vector<uint16_t> half(values.size());
+    in.read(reinterpret_cast<char*>(half.data()), half.size() * sizeof(uint16_t));
+    if (format == ValueFormat::Float16) {
+        SimdKernels::halfToFloat(half.data(), values.data(), values.size());
+    } else {
+        SimdKernels::bf16ToFloat(half.data(), values.data(), values.size());
+    }
+}
+
+// Search metadata the vector store keeps for a chunk's row
+// The store row shares the chunk's text instead of copying it
+static VectorStore::SharedText codeOf(const std::shared_ptr<const CodeChunk>& chunk) {
+    return VectorStore::SharedText(chunk, &chunk->code);
+}
+
+static RowMetadata chunkMetadata(const CodeChunk& chunk) {
+    return { chunk.fileName, chunk.symbolName, chunk.startLine, chunk.endLine, chunk.modifiedTime };
+}
+
 std::string sanitize_utf8(const std::string& input) {
     std::string output;
     output.reserve(input.size());
@@ -50,68 +111,174 @@ std::string sanitize_utf8(const std::string& input) {
 }
 
 
-size_t IndexManager::getCurrentMemoryUsage() const {
-    size_t total = 0;
-    for (const auto& c : chunks) {
-        total += c.fileName.size() + c.symbolName.size() + c.code.size();
-        total += sizeof(c.startLine) + sizeof(c.endLine);
-        total += c.embedding.size() * sizeof(float);
-    }
-    return total;
+size_t IndexManager::chunkMemory(const CodeChunk& c) {
+    return c.fileName.size() + c.symbolName.size() + c.code.size()
+         + sizeof(c.startLine) + sizeof(c.endLine) + c.embedding.memoryBytes();
 }
 
-const std::vector<CodeChunk>& IndexManager::getChunks() const {
-    return chunks; // return the internal vector of chunks
+size_t IndexManager::getCurrentMemoryUsage(const IndexSnapshot& snap) {
+    return snap.chunkBytes + snap.store.getMemoryUsage();
 }
-void IndexManager::enforceMemoryLimits() {
-    std::unique_lock lock(chunksMutex);  // exclusive lock for modification
 
-    if (chunks.size() > MAX_CHUNKS || getCurrentMemoryUsage() > MAX_TOTAL_SIZE) {
-        std::cout << "[RAG] Memory limits exceeded, removing oldest chunks\n";
-        
-        // Simple LRU: remove first 20% of chunks
-        size_t toRemove = chunks.size() / 5;
-        chunks.erase(chunks.begin(), chunks.begin() + toRemove);
+// ------------------------------------------------------------------
+// Snapshots
+// ------------------------------------------------------------------
+// A private copy of the published version for the writer to change
+std::shared_ptr<IndexSnapshot> IndexManager::draft() const {
+    return std::make_shared<IndexSnapshot>(*current.load());
+}
 
-        rebuildInternalStructures();  // also protected internally if needed
-        std::cout << "[RAG] Removed " << toRemove << " chunks\n";
+// Finishes deferred index work, then swaps the draft in. Readers that loaded
+// the old version keep it alive until their last query on it returns.
+void IndexManager::publish(std::shared_ptr<IndexSnapshot> next) {
+    enforceMemoryLimits(*next);
+    next->store.prepareSearch();
+    bool compact = next->store.needsCompaction();
+    current.store(std::move(next));
+    if (compact) {
+        std::lock_guard lock(compactMutex);
+        compactPending = true;
+        compactWake.notify_one();
     }
 }
 
+IndexManager::~IndexManager() {
+    {
+        std::lock_guard lock(compactMutex);
+        stopping = true;
+    }
+    compactWake.notify_one();
+    if (compactor.joinable()) compactor.join();
+}
+
+// Compacts a draft off the write path that tombstoned the rows. Writers wait
+// on writeMutex meanwhile; readers keep the published snapshot.
+void IndexManager::compactLoop() {
+    std::unique_lock lock(compactMutex);
+    while (true) {
+        compactWake.wait(lock, [this] { return compactPending || stopping; });
+        if (stopping) return;
+        compactPending = false;
+        lock.unlock();
+        {
+            std::lock_guard write(writeMutex);
+            if (current.load()->store.needsCompaction()) {
+                auto next = draft();
+                compactStore(*next);
+                publish(std::move(next));
+            }
+        }
+        lock.lock();
+    }
+}
+
+void IndexManager::compactStore(IndexSnapshot& next) {
+    auto& store = next.store;
+    if (store.deletedRows() == 0) return;
+    std::vector<uint8_t> keep(next.rowToChunk.size());
+    for (size_t row = 0; row < keep.size(); ++row) keep[row] = !store.isDeleted(row);
+    std::cerr << "[DEBUG] Compacting " << store.deletedRows() << " deleted rows\n";
+    store.compact();
+    next.rowToChunk.keepRows(keep);
+}
+
+bool IndexManager::overLimits(const IndexSnapshot& next) const {
+    return next.chunks.size() > MAX_CHUNKS
+        || (memoryLimit > 0 && getCurrentMemoryUsage(next) > memoryLimit);
+}
+
+// Victims follow the store's eviction policy (least recently or least often
+// retrieved). Eviction runs down to EVICT_TO_PERCENT of the limit it hit so
+// the next few additions do not trigger it again.
+void IndexManager::enforceMemoryLimits(IndexSnapshot& next) {
+    if (!overLimits(next)) return;
+    // Tombstoned rows hold their vectors until compacted; that may be enough
+    compactStore(next);
+
+    const auto& chunks = next.chunks;
+    size_t usage = getCurrentMemoryUsage(next);
+    bool overMemory = memoryLimit > 0 && usage > memoryLimit;
+    bool overCount = chunks.size() > MAX_CHUNKS;
+    if (!overMemory && !overCount) return;
+
+    size_t usageTarget = overMemory ? memoryLimit / 100 * EVICT_TO_PERCENT : usage;
+    size_t countTarget = overCount ? MAX_CHUNKS / 100 * EVICT_TO_PERCENT : chunks.size();
+    size_t remaining = chunks.size();
+    auto fits = [&] { return usage <= usageTarget && remaining <= countTarget; };
+    std::vector<uint8_t> keep(chunks.size(), 1);
+
+    // A chunk without a store row can never be retrieved, so it goes first
+    std::vector<uint8_t> hasRow(chunks.size(), 0);
+    for (size_t c : next.rowToChunk) {
+        if (c != IndexSnapshot::NO_CHUNK) hasRow[c] = 1;
+    }
+    for (size_t c = 0; c < chunks.size() && !fits(); ++c) {
+        if (hasRow[c]) continue;
+        usage -= std::min(usage, chunkMemory(*chunks[c]));
+        keep[c] = 0;
+        --remaining;
+    }
+    for (uint32_t row : next.store.evictionOrder()) {
+        if (fits()) break;
+        size_t c = next.rowToChunk[row];
+        usage -= std::min(usage, chunkMemory(*chunks[c]) + next.store.rowMemoryBytes(row));
+        keep[c] = 0;
+        --remaining;
+    }
 
+    size_t evicted = eraseChunks(next, keep);
+    compactStore(next);
+    std::cout << "[RAG] Index over its " << (overMemory ? "memory" : "chunk") << " limit, evicted "
+              << evicted << " least-used chunks\n";
+}
 
-void IndexManager::removeChunksFromPath(const std::string& rootPath) {
-    std::unique_lock lock(chunksMutex); // exclusive lock for writes
-    chunks.erase(std::remove_if(chunks.begin(), chunks.end(),
-        [&](const CodeChunk& c) { 
-            return c.fileName.rfind(rootPath, 0) == 0; 
-        }), chunks.end());
+// Survivors keep their order, rows and retrieval history
+size_t IndexManager::eraseChunks(IndexSnapshot& next, const std::vector<uint8_t>& keep) {
+    auto& chunks = next.chunks;
+    auto kept = [&](size_t i) { return i >= keep.size() || keep[i]; };
+    std::vector<size_t> newIndex(chunks.size());
+    size_t out = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (!kept(i)) {
+            next.chunkBytes -= chunkMemory(*chunks[i]);
+            if (engine) engine->unfit(chunks[i]->code);
+            continue;
+        }
+        newIndex[i] = out;
+        if (out != i) chunks.set(out, chunks[i]);
+        ++out;
+    }
+    size_t dropped = chunks.size() - out;
+    if (dropped == 0) return 0;
+
+    for (size_t row = 0; row < next.rowToChunk.size(); ++row) {
+        size_t c = next.rowToChunk[row];
+        if (c == IndexSnapshot::NO_CHUNK) continue;
+        if (kept(c)) {
+            if (newIndex[c] != c) next.rowToChunk.set(row, newIndex[c]);
+        } else {
+            next.store.removeDocument(row);
+            next.rowToChunk.set(row, IndexSnapshot::NO_CHUNK);
+        }
+    }
+    chunks.truncate(out);
+    return dropped;
 }
 
 // --- Clear all chunks, store, and mappings ---
 void IndexManager::clear() {
-    std::unique_lock lock(chunksMutex);
-    chunks.clear();
-    codeToChunkIndex.clear();
-    store.clear();
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    next->chunks.clear();
+    next->chunkBytes = 0;
+    next->rowToChunk.clear();
+    next->store.clear();
+    publish(std::move(next));
+    // The corpus is gone, so are its statistics; reindexing fits afresh
+    if (engine) engine->fit({});
     std::cout << "[IndexManager] Cleared all in-memory chunks and store.\n";
 }
 
-// --- Add single chunk safely (renamed from addChunkToIndex) ---
-void IndexManager::addChunk(CodeChunk&& chunk) {
-    std::cerr << "[DEBUG] Adding chunk: file=" << chunk.fileName
-              << ", symbol=" << chunk.symbolName
-              << ", start=" << chunk.startLine
-              << ", end=" << chunk.endLine
-              << ", code size=" << chunk.code.size()
-              << ", embedding size=" << chunk.embedding.size() << "\n";
-    std::unique_lock lock(chunksMutex);
-    size_t index = chunks.size();
-    chunks.push_back(std::move(chunk));
-    store.addDocument(chunks.back().code);
-    codeToChunkIndex[chunks.back().code] = index;
-}
-
 
 void IndexManager::init(const std::string& indexPath) {
     FileHandler fh;
@@ -123,35 +290,83 @@ void IndexManager::init(const std::string& indexPath) {
         indexFilePath = fh.getRagPath("rag_index.bin");
     }
     std::cout << "[RAG] Loading index from: " << indexFilePath << "\n";
-    loadIndex(indexFilePath);
 
-    // Prune chunks not under RAG directory
-    std::string ragDir = fh.getRagDirectory();
-    size_t originalSize = chunks.size();
-
-    chunks.erase(std::remove_if(chunks.begin(), chunks.end(),
-        [&](const CodeChunk& c){
-            return !pathIsUnderDirectory(c.fileName, ragDir);
-        }), chunks.end());
+    // Load and prune in one draft so readers only see the result
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    loadIndexInto(*next, indexFilePath);
 
-    if (originalSize != chunks.size()) {
-        std::cout << "[RAG] Pruned " << (originalSize - chunks.size())
-                  << " out-of-scope chunks\n";
+    // Prune chunks not under RAG directory; the rest keep their loaded vectors
+    std::string ragDir = fh.getRagDirectory();
+    std::vector<uint8_t> keep(next->chunks.size(), 1);
+    for (size_t i = 0; i < next->chunks.size(); ++i) {
+        keep[i] = pathIsUnderDirectory(next->chunks[i]->fileName, ragDir);
     }
+    size_t pruned = eraseChunks(*next, keep);
+    if (pruned > 0) {
+        std::cout << "[RAG] Pruned " << pruned << " out-of-scope chunks\n";
+    }
+    size_t ready = next->chunks.size();
+    publish(std::move(next));
 
-    // Rebuild vector store + mappings
-    rebuildInternalStructures();
-
-    std::cout << "[RAG] Initialization complete: " << chunks.size()
+    std::cout << "[RAG] Initialization complete: " << ready
               << " chunks ready\n";
 }
 
 
 void IndexManager::indexFile(const std::string& filePath) {
+    indexFiles({ filePath });
+}
+
+void IndexManager::indexFiles(const std::vector<std::string>& filePaths) {
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    ChunkLayout layout = layoutOf(*next);
+    for (const auto& path : filePaths) {
+        indexFileInto(*next, path, layout);
+        // Evicting renumbers the chunks, so the layout is taken afresh
+        if (overLimits(*next)) {
+            eraseChunks(*next, layout.keep);
+            enforceMemoryLimits(*next);
+            layout = layoutOf(*next);
+        }
+    }
+    eraseChunks(*next, layout.keep);
+    publish(std::move(next));
+}
+
+IndexManager::ChunkLayout IndexManager::layoutOf(const IndexSnapshot& next) {
+    ChunkLayout layout;
+    for (size_t i = 0; i < next.chunks.size(); ++i) layout.byFile[next.chunks[i]->fileName].push_back(i);
+    layout.rowOf.assign(next.chunks.size(), IndexSnapshot::NO_CHUNK);
+    for (size_t row = 0; row < next.rowToChunk.size(); ++row) {
+        if (next.rowToChunk[row] != IndexSnapshot::NO_CHUNK) layout.rowOf[next.rowToChunk[row]] = row;
+    }
+    layout.keep.assign(next.chunks.size(), 1);
+    return layout;
+}
+
+void IndexManager::indexFileInto(IndexSnapshot& next, const std::string& filePath,
+                                 ChunkLayout& layout) {
+    std::string key = fs::absolute(filePath).lexically_normal().string();
+    std::vector<size_t> previous;
+    if (auto it = layout.byFile.find(key); it != layout.byFile.end()) previous = it->second;
+    std::vector<CodeChunk> fresh;
+
+    // Whatever the file yields replaces what it had; an unreadable or empty
+    // file leaves nothing behind
+    auto place = [&] {
+        size_t reused = std::min(previous.size(), fresh.size());
+        for (size_t k = 0; k < reused; ++k) replaceChunk(next, previous[k], std::move(fresh[k]), layout);
+        for (size_t k = reused; k < previous.size(); ++k) layout.keep[previous[k]] = 0;
+        for (size_t k = reused; k < fresh.size(); ++k) addChunkToIndex(next, std::move(fresh[k]));
+    };
+
     // Read the file contents; store absolute path
     std::ifstream in(filePath, std::ios::binary);
     if (!in) {
         std::cerr << "[RAG] Failed to open file for indexing: " << filePath << "\n";
+        place();
         return;
     }
 
@@ -162,6 +377,7 @@ void IndexManager::indexFile(const std::string& filePath) {
     // Skip empty files
     if (content.empty()) {
         std::cerr << "[RAG] File is empty, skipping: " << filePath << "\n";
+        place();
         return;
     }
 
@@ -171,6 +387,7 @@ void IndexManager::indexFile(const std::string& filePath) {
     }
 
     content = sanitize_utf8(content);
+    int64_t modified = fileModifiedTime(filePath);
     //Chunker chunker;
     // Create smart chunks (may return empty)
     auto chunksVec = Chunker::createSmartChunks(filePath, content);
@@ -188,10 +405,11 @@ void IndexManager::indexFile(const std::string& filePath) {
                   << filePath << ". Adding whole file as a single chunk.\n";
 
         CodeChunk fallbackChunk;
-        fallbackChunk.fileName = fs::absolute(filePath).lexically_normal().string();
+        fallbackChunk.fileName = key;
         fallbackChunk.symbolName = "";
         fallbackChunk.startLine = 1;
         fallbackChunk.endLine = 0;
+        fallbackChunk.modifiedTime = modified;
         fallbackChunk.code = std::move(content); // move the big string
 
         // Remove null bytes
@@ -199,24 +417,20 @@ void IndexManager::indexFile(const std::string& filePath) {
                                  fallbackChunk.code.end());
 
         try {
-            fallbackChunk.embedding = engine->embed(fallbackChunk.code);
+            engine->partialFit(fallbackChunk.code);
+            fallbackChunk.embedding = engine->embedSparse(fallbackChunk.code);
         } catch (const std::exception& ex) {
             std::cerr << "[ERROR] Embedding failed for fallback chunk (" << filePath
                       << "): " << ex.what() << "\n";
         }
 
-        addChunkToIndex(std::move(fallbackChunk));
-        try {
-            store.addDocument(chunksVec.empty() ? fallbackChunk.code : std::string()); // best-effort
-        } catch (const std::exception& ex) {
-            std::cerr << "[WARN] store.addDocument failed for fallback chunk: " << ex.what() << "\n";
-        }
+        fresh.push_back(std::move(fallbackChunk));
+        place();
         std::cerr << "[DEBUG] Indexed file with 1 fallback chunk: " << filePath << "\n";
         return;
     }
 
-    // Process each chunk: generate embedding, add to index and to vector store
-    size_t added = 0;
+    // Process each chunk: generate embedding and keep it for placement
     for (size_t i = 0; i < chunksVec.size(); ++i) {
         CodeChunk &chunkRef = chunksVec[i];
 
@@ -245,49 +459,78 @@ void IndexManager::indexFile(const std::string& filePath) {
             continue;
         }
 
+        // Indexed chunks join the corpus statistics; queries never do. A
+        // chunk that is skipped after all is taken back out.
+        bool fitted = false;
         try {
-            chunkRef.embedding = engine->embed(chunkRef.code);
+            engine->partialFit(chunkRef.code);
+            fitted = true;
+            chunkRef.embedding = engine->embedSparse(chunkRef.code);
 
             // Skip zero-norm embeddings
-            bool isZero = std::all_of(
-                chunkRef.embedding.begin(),
-                chunkRef.embedding.end(),
-                [](float v){ return v == 0.0f; }
-            );
-            if (isZero) {
+            if (chunkRef.embedding.nnz() == 0) {
                 std::cerr << "[WARN] Skipping zero-norm embedding for chunk " << i
                           << " in file: " << filePath << "\n";
+                engine->unfit(chunkRef.code);
                 continue;
             }
 
         } catch (const std::exception& ex) {
             std::cerr << "[ERROR] Embedding failed for chunk " << i << " ("
                       << filePath << "): " << ex.what() << " — skipping chunk.\n";
+            if (fitted) engine->unfit(chunkRef.code);
             continue;
         }
 
-        // Move the chunk out of the vector into a local variable before adding
-        CodeChunk chunk = std::move(chunkRef);
-
-        // Add to RAG in-memory index
-        addChunkToIndex(std::move(chunk));
-
-        // Add the chunk text to the vector store. Use chunk.code (still valid).
-        try {
-            store.addDocument(chunk.code);
-        } catch (const std::exception& ex) {
-            std::cerr << "[WARN] store.addDocument failed for chunk " << i
-                      << " (" << filePath << "): " << ex.what() << "\n";
-        }
-
-        ++added;
+        // One spelling of the path, so the file's chunks are found again on reindex
+        chunkRef.fileName = key;
+        chunkRef.modifiedTime = modified;
+        fresh.push_back(std::move(chunkRef));
     }
 
+    size_t added = fresh.size();
+    size_t replaced = std::min(previous.size(), added);
+    place();
     std::cerr << "[DEBUG] Indexed file with " << added
               << " chunk(s) (requested: " << chunksVec.size()
+              << ", replaced in place: " << replaced
               << "): " << filePath << "\n";
 }
 
+// Overwrites chunks[index] and its store row; the row is reused when the
+// store can update it in place
+void IndexManager::replaceChunk(IndexSnapshot& next, size_t index, CodeChunk&& chunk,
+                                ChunkLayout& layout) {
+    std::cerr << "[DEBUG] Replacing chunk " << index << ": file=" << chunk.fileName
+              << ", symbol=" << chunk.symbolName
+              << ", start=" << chunk.startLine
+              << ", end=" << chunk.endLine << "\n";
+    if (engine) engine->unfit(next.chunks[index]->code);
+    next.chunkBytes -= chunkMemory(*next.chunks[index]);
+    next.chunkBytes += chunkMemory(chunk);
+    next.chunks.set(index, std::make_shared<const CodeChunk>(std::move(chunk)));
+
+    size_t row = layout.rowOf[index];
+    if (row == IndexSnapshot::NO_CHUNK || next.chunks[index]->embedding.empty()) {
+        if (row != IndexSnapshot::NO_CHUNK) {
+            next.store.removeDocument(row);
+            next.rowToChunk.set(row, IndexSnapshot::NO_CHUNK);
+        }
+        addChunkToStore(next, index);
+        layout.rowOf[index] = next.store.size() - 1;
+        return;
+    }
+
+    const auto& stored = next.chunks[index];
+    size_t moved = next.store.updateDocument(row, codeOf(stored), stored->embedding);
+    next.store.setRowMetadata(moved, chunkMetadata(*stored));
+    if (moved != row) {
+        next.rowToChunk.set(row, IndexSnapshot::NO_CHUNK);
+        next.rowToChunk.push_back(index);
+        layout.rowOf[index] = moved;
+    }
+}
+
 void IndexManager::indexProject(const std::string& rootPath) {
     if (!fs::exists(rootPath)) {
         std::cerr << "[RAG] Path does not exist: " << rootPath << "\n";
@@ -299,41 +542,76 @@ void IndexManager::indexProject(const std::string& rootPath) {
         return;
     }
     
-    int successCount = 0, errorCount = 0;
-    
-    // Remove old chunks from this path first
-    size_t oldSize = chunks.size();
-    removeChunksFromPath(rootPath);
-    
-    if (oldSize != chunks.size()) {
-        std::cout << "[RAG] Removed " << (oldSize - chunks.size()) 
-                  << " old chunks from: " << rootPath << "\n";
-        rebuildInternalStructures();
-    }
-    
+    int successCount = 0, unchangedCount = 0, errorCount = 0;
+
+    // The whole pass builds one draft; queries keep using the published
+    // index until it is swapped in at the end
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    ChunkLayout layout = layoutOf(*next);
+    std::set<std::string> seen;
+
     try {
         for (const auto& entry : fs::recursive_directory_iterator(rootPath)) {
             if (!entry.is_regular_file()) continue;
             
             auto ext = entry.path().extension().string();
-            if (isSupportedExtension(ext)) {
-                try {
-                    indexFile(entry.path().string());
-                    successCount++;
-                } catch (const std::exception& e) {
-                    std::cerr << "[RAG] Error indexing " << entry.path() 
-                              << ": " << e.what() << "\n";
-                    errorCount++;
-                }
+            if (!isSupportedExtension(ext)) continue;
+
+            std::string path = entry.path().string();
+            std::string key = fs::absolute(path).lexically_normal().string();
+            seen.insert(key);
+
+            // Only files changed since they were indexed are re-embedded
+            auto it = layout.byFile.find(key);
+            int64_t modified = fileModifiedTime(path);
+            if (it != layout.byFile.end() && modified != 0
+                && std::all_of(it->second.begin(), it->second.end(), [&](size_t c) {
+                       return next->chunks[c]->modifiedTime == modified;
+                   })) {
+                unchangedCount++;
+                continue;
+            }
+
+            try {
+                indexFileInto(*next, path, layout);
+                successCount++;
+            } catch (const std::exception& e) {
+                std::cerr << "[RAG] Error indexing " << entry.path() 
+                          << ": " << e.what() << "\n";
+                errorCount++;
+            }
+
+            // Evicting renumbers the chunks, so the layout is taken afresh
+            if (overLimits(*next)) {
+                eraseChunks(*next, layout.keep);
+                enforceMemoryLimits(*next);
+                layout = layoutOf(*next);
             }
         }
     } catch (const fs::filesystem_error& e) {
         std::cerr << "[RAG] Filesystem error: " << e.what() << "\n";
         return;
     }
+
+    // Files that disappeared from under the root take their chunks with them
+    size_t removed = 0;
+    for (const auto& [file, indices] : layout.byFile) {
+        if (seen.count(file) || !pathIsUnderDirectory(file, rootPath)) continue;
+        for (size_t c : indices) layout.keep[c] = 0;
+        removed += indices.size();
+    }
+    if (removed > 0) {
+        std::cout << "[RAG] Removed " << removed 
+                  << " chunks of deleted files under: " << rootPath << "\n";
+    }
+    eraseChunks(*next, layout.keep);
+
+    publish(std::move(next));
     
     std::cout << "[RAG] Indexed " << fs::absolute(rootPath) 
-              << " - Success: " << successCount << ", Errors: " << errorCount << "\n";
+              << " - Success: " << successCount << ", Unchanged: " << unchangedCount
+              << ", Errors: " << errorCount << "\n";
 }
 
 
@@ -356,12 +634,24 @@ void IndexManager::saveIndex(const std::string& dbPath) const {
         return;
     }
 
+    // Saves one consistent version even if a reindex publishes meanwhile
+    auto snap = snapshot();
+    const auto& chunks = snap->chunks;
+    const auto& store = snap->store;
+
+    // Header: magic + format version
+    out.write(reinterpret_cast<const char*>(&INDEX_MAGIC), sizeof(INDEX_MAGIC));
+    out.write(reinterpret_cast<const char*>(&INDEX_VERSION), sizeof(INDEX_VERSION));
+    ValueFormat format = valueFormatFor(store.getStorage());
+    out.write(reinterpret_cast<const char*>(&format), sizeof(format));
+
     // Write number of chunks
     size_t n = chunks.size();
     out.write(reinterpret_cast<const char*>(&n), sizeof(n));
 
     // Write chunks
-    for (const auto& c : chunks) {
+    for (const auto& chunk : chunks) {
+        const CodeChunk& c = *chunk;
         size_t len;
 
         len = c.fileName.size();
@@ -374,16 +664,19 @@ void IndexManager::saveIndex(const std::string& dbPath) const {
 
         out.write(reinterpret_cast<const char*>(&c.startLine), sizeof(c.startLine));
         out.write(reinterpret_cast<const char*>(&c.endLine), sizeof(c.endLine));
+        out.write(reinterpret_cast<const char*>(&c.modifiedTime), sizeof(c.modifiedTime));
 
         len = c.code.size();
         out.write(reinterpret_cast<const char*>(&len), sizeof(len));
         out.write(c.code.data(), len);
 
-        // Write embedding
-        len = c.embedding.size();
+        // Write sparse embedding: dimension, nnz, indices, values (in format)
+        out.write(reinterpret_cast<const char*>(&c.embedding.dimension), sizeof(c.embedding.dimension));
+        len = c.embedding.nnz();
         out.write(reinterpret_cast<const char*>(&len), sizeof(len));
         if (len > 0) {
-            out.write(reinterpret_cast<const char*>(c.embedding.data()), len * sizeof(float));
+            out.write(reinterpret_cast<const char*>(c.embedding.indices.data()), len * sizeof(uint32_t));
+            writeValues(out, c.embedding.values, format);
         }
     }
 
@@ -400,6 +693,29 @@ void IndexManager::saveIndex(const std::string& dbPath) const {
         std::filesystem::remove(tmpFile);
     }
 
+    // Store row order: updates and compaction leave rows out of chunk order,
+    // and the saved ANN index only fits rows rebuilt in this order
+    std::vector<size_t> rowOrder;
+    rowOrder.reserve(store.liveSize());
+    for (size_t row = 0; row < snap->rowToChunk.size(); ++row) {
+        if (snap->rowToChunk[row] != IndexSnapshot::NO_CHUNK) rowOrder.push_back(snap->rowToChunk[row]);
+    }
+    size_t rows = rowOrder.size();
+    out.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    out.write(reinterpret_cast<const char*>(rowOrder.data()), rows * sizeof(size_t));
+
+    // The ANN index lives next to the index so it need not be rebuilt on load.
+    // Tombstoned rows are not reloaded, so an index covering them is useless.
+    std::string annPath = dbPath + ".ann";
+    if (store.getSearchIndex() != VectorStore::SearchIndex::Flat && store.deletedRows() == 0) {
+        if (!store.saveAnnIndex(annPath)) {
+            std::cerr << "[basic_agent:RAG] Failed to save ANN index to " << annPath << "\n";
+        }
+    } else {
+        std::error_code ec;
+        std::filesystem::remove(annPath, ec);
+    }
+
     std::cout << "[basic_agent:RAG] Index saved to: " << dbPath
               << " (entries=" << n << ")\n";
 } 
@@ -415,20 +731,38 @@ void IndexManager::loadIndex() {
 
 // ----------------- loadIndex (unified layout) -----------------
 void IndexManager::loadIndex(const std::string& dbPath) {
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    loadIndexInto(*next, dbPath);
+    publish(std::move(next));
+}
+
+void IndexManager::loadIndexInto(IndexSnapshot& next, const std::string& dbPath) {
     std::ifstream in(dbPath, std::ios::binary);
     if (!in) {
         std::cerr << "[basic_agent:RAG] No index found at " << dbPath << " (starting fresh).\n";
         return;
     }
 
+    uint32_t magic = 0, version = 0;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    // Version 2 lacks the file mtimes (they load as 0); before 4 values are float32
+    ValueFormat format = ValueFormat::Float32;
+    if (version >= 4) in.read(reinterpret_cast<char*>(&format), sizeof(format));
+    if (!in || magic != INDEX_MAGIC || version < 2 || version > INDEX_VERSION
+        || format > ValueFormat::BFloat16) {
+        std::cerr << "[basic_agent:RAG] Index at " << dbPath
+                  << " has an unsupported format (starting fresh).\n";
+        return;
+    }
+
     size_t n;
     in.read(reinterpret_cast<char*>(&n), sizeof(n));
 
-    {
-        std::unique_lock lock(chunksMutex);  // lock for writes
-        chunks.clear(); 
-        chunks.reserve(n);
-    }
+    auto& chunks = next.chunks;
+    chunks.clear();
+    next.chunkBytes = 0;
 
     for (size_t i = 0; i < n; ++i) {
         CodeChunk c; size_t len;
@@ -443,25 +777,27 @@ void IndexManager::loadIndex(const std::string& dbPath) {
 
         in.read(reinterpret_cast<char*>(&c.startLine), sizeof(c.startLine));
         in.read(reinterpret_cast<char*>(&c.endLine), sizeof(c.endLine));
+        if (version >= 3) in.read(reinterpret_cast<char*>(&c.modifiedTime), sizeof(c.modifiedTime));
 
         in.read(reinterpret_cast<char*>(&len), sizeof(len));
         c.code.resize(len);
         in.read(&c.code[0], len);
 
-        // Read embedding
+        // Read sparse embedding
         size_t embLen;
+        in.read(reinterpret_cast<char*>(&c.embedding.dimension), sizeof(c.embedding.dimension));
         in.read(reinterpret_cast<char*>(&embLen), sizeof(embLen));
-        c.embedding.resize(embLen);
+        c.embedding.indices.resize(embLen);
+        c.embedding.values.resize(embLen);
         if (embLen > 0) {
-            in.read(reinterpret_cast<char*>(c.embedding.data()), embLen * sizeof(float));
+            in.read(reinterpret_cast<char*>(c.embedding.indices.data()), embLen * sizeof(uint32_t));
+            readValues(in, c.embedding.values, format);
         }
 
         try { c.fileName = fs::absolute(c.fileName).lexically_normal().string(); } catch (...) {}
 
-        {
-            std::unique_lock lock(chunksMutex);
-            chunks.push_back(std::move(c));
-        }
+        next.chunkBytes += chunkMemory(c);
+        chunks.push_back(std::make_shared<const CodeChunk>(std::move(c)));
     }
 
     // Restore engine state
@@ -479,18 +815,57 @@ void IndexManager::loadIndex(const std::string& dbPath) {
         std::filesystem::remove(tmpFile);
     }
 
+    // The statistics count each chunk once. Older states also counted
+    // re-embedded and removed chunks, so they are rebuilt from the chunks.
+    if (engine && !engine->coversDocuments(chunks.size())) {
+        std::cerr << "[WARN] Corpus statistics in " << dbPath << " do not match its "
+                  << chunks.size() << " chunks; refitting them.\n";
+        std::vector<std::string_view> texts;
+        texts.reserve(chunks.size());
+        for (const auto& c : chunks) texts.push_back(c->code);
+        engine->refit(texts);
+    }
+
+    // Rows go back in the saved store order; chunks it does not list (and
+    // every chunk of older files) follow in chunk order
+    std::vector<size_t> rowOrder;
+    if (version >= 5) {
+        size_t rows = 0;
+        in.read(reinterpret_cast<char*>(&rows), sizeof(rows));
+        if (in && rows <= n) {
+            rowOrder.resize(rows);
+            in.read(reinterpret_cast<char*>(rowOrder.data()), rows * sizeof(size_t));
+        }
+        if (!in) rowOrder.clear();
+    }
+    std::vector<uint8_t> placed(n, 0);
+    for (size_t i : rowOrder) {
+        if (i >= n || placed[i]) {
+            std::cerr << "[WARN] Saved row order in " << dbPath << " is invalid; using chunk order.\n";
+            rowOrder.clear();
+            std::fill(placed.begin(), placed.end(), 0);
+            break;
+        }
+        placed[i] = 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!placed[i]) rowOrder.push_back(i);
+    }
+
     // Rebuild store from loaded chunks
     {
-        std::unique_lock lock(chunksMutex);
+        auto& store = next.store;
+        // Add rows unindexed, then adopt the saved ANN index if it still matches
+        auto searchIndex = store.getSearchIndex();
+        store.setSearchIndex(VectorStore::SearchIndex::Flat);
         store.clear();
-        codeToChunkIndex.clear();
-        for (size_t i = 0; i < chunks.size(); ++i) {
-            auto& c = chunks[i];
-            if (!c.embedding.empty()) {
-                store.addDocument(c.code);
-                store.embeddings.back() = c.embedding;
-                codeToChunkIndex[c.code] = i;
-            }
+        next.rowToChunk.clear();
+        for (size_t i : rowOrder) {
+            if (!chunks[i]->embedding.empty()) addChunkToStore(next, i);
+        }
+        if (searchIndex != VectorStore::SearchIndex::Flat) {
+            store.loadAnnIndex(dbPath + ".ann");
+            store.setSearchIndex(searchIndex);
         }
     }
 
@@ -498,34 +873,114 @@ void IndexManager::loadIndex(const std::string& dbPath) {
               << " (entries=" << n << ")\n";
 }
 
-void IndexManager::rebuildInternalStructures() {
-    std::unique_lock lock(chunksMutex);  // exclusive access to chunks and codeToChunkIndex
-
-    store.clear();
-    codeToChunkIndex.clear();
-
-    std::cout << "[RAG] Rebuilding vector store..." << std::flush;
+void IndexManager::applyConfig(const Config& config) {
+    HnswIndex::Params hnsw;
+    hnsw.M = config.hnsw_m;
+    hnsw.efConstruction = config.hnsw_ef_construction;
+    hnsw.efSearch = config.hnsw_ef_search;
+
+    auto searchIndex = VectorStore::SearchIndex::Flat;
+    if (config.ann_index == "hnsw") searchIndex = VectorStore::SearchIndex::Hnsw;
+    else if (config.ann_index == "ivf") searchIndex = VectorStore::SearchIndex::Ivf;
+    else if (config.ann_index == "binary") searchIndex = VectorStore::SearchIndex::Binary;
+
+    auto storage = VectorStore::Storage::Float32;
+    if (config.embedding_storage == "int8") storage = VectorStore::Storage::Int8;
+    else if (config.embedding_storage == "fp16") storage = VectorStore::Storage::Float16;
+    else if (config.embedding_storage == "bf16") storage = VectorStore::Storage::BFloat16;
+
+    // Re-quantizing or relinking happens on the draft, off the query path
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    auto& store = next->store;
+
+    IvfIndex::Params ivf = store.getIvfParams();
+    ivf.nlist = config.ivf_nlist;
+    ivf.nprobe = config.ivf_nprobe;
+
+    store.setStorage(storage);
+    store.setScoreThreshold(static_cast<float>(config.similarity_threshold));
+    store.setSearchThreads(config.search_threads);
+    store.setDiversity(config.retrieval_mode == "mmr" ? static_cast<float>(config.mmr_lambda) : 1.0f);
+    store.setHnswParams(hnsw);
+    store.setIvfParams(ivf);
+    store.setBinaryParams({ config.binary_candidates });
+    store.setSearchIndex(searchIndex);
+    store.setEvictionPolicy(config.eviction_policy == "lfu" ? RowAccessLog::Policy::Lfu
+                                                            : RowAccessLog::Policy::Lru);
+    memoryLimit = config.memory_limit_mb * 1024 * 1024;
+    publish(std::move(next));
+}
 
-    for (size_t i = 0; i < chunks.size(); ++i) {
-        const auto& chunk = chunks[i];
-        store.addDocument(chunk.code);
-        codeToChunkIndex[chunk.code] = i;
-    }
+void IndexManager::retrainIvf() {
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    next->store.trainIvf();
+    publish(std::move(next));
+}
 
-    std::cout << " done (" << chunks.size() << " embeddings)\n";
+void IndexManager::setSimilarity(std::unique_ptr<ISimilarity> sim) {
+    std::lock_guard lock(writeMutex);
+    auto next = draft();
+    next->store.setSimilarity(std::move(sim));
+    publish(std::move(next));
 }
 
-// --- Add single chunk safely ---
-void IndexManager::addChunkToIndex(CodeChunk&& chunk) {
+// --- Add single chunk to a draft ---
+void IndexManager::addChunkToIndex(IndexSnapshot& next, CodeChunk&& chunk) {
         std::cerr << "[DEBUG] Adding chunk: file=" << chunk.fileName
               << ", symbol=" << chunk.symbolName
               << ", start=" << chunk.startLine
               << ", end=" << chunk.endLine
               << ", code size=" << chunk.code.size()
-              << ", embedding size=" << chunk.embedding.size() << "\n";
-    std::unique_lock lock(chunksMutex);
-    size_t index = chunks.size();
-    chunks.push_back(std::move(chunk));
-    store.addDocument(chunks.back().code);
-    codeToChunkIndex[chunks.back().code] = index;
+              << ", embedding nnz=" << chunk.embedding.nnz() << "\n";
+    next.chunkBytes += chunkMemory(chunk);
+    next.chunks.push_back(std::make_shared<const CodeChunk>(std::move(chunk)));
+    addChunkToStore(next, next.chunks.size() - 1);
+}
+
+// Feed chunks[index] to the vector store, reusing its embedding when present
+void IndexManager::addChunkToStore(IndexSnapshot& next, size_t index) {
+    const auto& chunk = next.chunks[index];
+    auto& store = next.store;
+    if (chunk->embedding.empty()) {
+        // Embedded here rather than by the store, which would fit the text a
+        // second time; indexing already counted it
+        SparseVector embedding;
+        try {
+            embedding = engine->embedSparse(chunk->code);
+        } catch (const std::exception& ex) {
+            std::cerr << "[ERROR] Embedding failed for chunk " << index << ": " << ex.what() << "\n";
+        }
+        store.addDocument(codeOf(chunk), embedding);
+    } else {
+        store.addDocument(codeOf(chunk), chunk->embedding);
+    }
+    store.setRowMetadata(store.size() - 1, chunkMetadata(*chunk));
+    next.rowToChunk.push_back(index);
+}
+
+// ------------------------------------------------------------------
+// Retrieval (readers; no locks)
+// ------------------------------------------------------------------
+std::vector<ChunkHit> IndexSnapshot::retrieveChunks(const std::string& query, int topK,
+                                                    const SearchFilter& filter) const {
+    auto results = retrieveChunksBatch({ query }, topK, filter);
+    return results.empty() ? std::vector<ChunkHit>{} : std::move(results.front());
+}
+
+std::vector<std::vector<ChunkHit>> IndexSnapshot::retrieveChunksBatch(
+    const std::vector<std::string>& queries, int topK, const SearchFilter& filter) const {
+    auto hits = store.retrieveBatch(queries, topK, filter);
+
+    std::vector<std::vector<ChunkHit>> results(hits.size());
+    for (size_t q = 0; q < hits.size(); ++q) {
+        results[q].reserve(hits[q].size());
+        for (const auto& hit : hits[q]) {
+            if (hit.doc < rowToChunk.size() && rowToChunk[hit.doc] != NO_CHUNK) {
+                results[q].push_back({ rowToChunk[hit.doc], hit.score });
+            }
+        }
+    }
+    return results;
 }
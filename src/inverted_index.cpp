@@ -0,0 +1,149 @@
+#include "../include/inverted_index.h"
+#include <algorithm>
+#include <cmath>
+
+void InvertedIndex::setDimension(size_t dim) {
+    postings.clear();
+    postings.resize(dim);
+}
+
+void InvertedIndex::addDocument(uint32_t doc, SparseRowView row, float squaredNorm) {
+    float invNorm = squaredNorm > 0.0f ? 1.0f / std::sqrt(squaredNorm) : 0.0f;
+
+    for (size_t k = 0; k < row.nnz(); ++k) {
+        if (row.indices[k] >= postings.size()) continue;
+        PostingList& list = *postings.mutableRow(row.indices[k]);
+        float w = row.values[k];
+        float scaled = w * invNorm;
+
+        if (list.docs.empty()) {
+            list.maxWeight = list.minWeight = w;
+            list.maxScaled = list.minScaled = scaled;
+        } else {
+            list.maxWeight = std::max(list.maxWeight, w);
+            list.minWeight = std::min(list.minWeight, w);
+            list.maxScaled = std::max(list.maxScaled, scaled);
+            list.minScaled = std::min(list.minScaled, scaled);
+        }
+        list.docs.push_back(doc);
+        list.weights.push_back(w);
+    }
+}
+
+void InvertedIndex::clear() {
+    size_t terms = postings.size();
+    postings.clear();
+    postings.resize(terms);
+}
+
+// ------------------------------------------------------------------
+// WAND top-k
+// ------------------------------------------------------------------
+std::vector<SearchHit> InvertedIndex::search(SparseRowView query, Scoring scoring,
+                                             size_t topK, float minScore,
+                                             const SharedRows<float>* rowSquaredNorms,
+                                             const Accept& accept) const {
+    if (topK == 0) return {};
+
+    float queryNorm = std::sqrt(SparseKernels::squaredNorm(query));
+    if (scoring == Scoring::Cosine && queryNorm == 0.0f) return {};
+    float queryScale = (scoring == Scoring::Cosine) ? 1.0f / queryNorm : 1.0f;
+
+    struct Cursor {
+        const PostingList* list;
+        size_t pos;
+        float queryWeight;
+        float upperBound;   // max contribution of this term to any score, >= 0
+
+        uint32_t doc() const { return list->docs[pos]; }
+    };
+
+    std::vector<Cursor> cursors;
+    cursors.reserve(query.nnz());
+    for (size_t k = 0; k < query.nnz(); ++k) {
+        if (query.indices[k] >= postings.size()) continue;
+        const PostingList& list = postings[query.indices[k]];
+        if (list.docs.empty()) continue;
+
+        float qw = query.values[k] * queryScale;
+        float hi = (scoring == Scoring::Cosine) ? list.maxScaled : list.maxWeight;
+        float lo = (scoring == Scoring::Cosine) ? list.minScaled : list.minWeight;
+        // Clamp at zero so prefix sums of bounds are monotone (weights may be negative)
+        float ub = std::max(0.0f, qw >= 0.0f ? qw * hi : qw * lo);
+        cursors.push_back({ &list, 0, query.values[k], ub });
+    }
+
+    // Documents arrive in increasing order, so ties keep the earlier one like the full scan
+    TopK heap(topK);
+
+    auto threshold = [&]() {
+        return heap.full() ? std::max(minScore, heap.worstScore()) : minScore;
+    };
+    // Slack so rounding in the bound sums never prunes a qualifying document
+    auto reachable = [](float bound, float theta) {
+        return bound >= theta - 1e-6f * (1.0f + std::fabs(theta));
+    };
+    auto byDoc = [](const Cursor& a, const Cursor& b) { return a.doc() < b.doc(); };
+
+    while (!cursors.empty()) {
+        std::sort(cursors.begin(), cursors.end(), byDoc);
+
+        // Pivot: first cursor at which the accumulated upper bound can reach theta
+        float theta = threshold();
+        float bound = 0.0f;
+        size_t pivot = cursors.size();
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            bound += cursors[i].upperBound;
+            if (reachable(bound, theta)) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == cursors.size()) break;
+
+        uint32_t pivotDoc = cursors[pivot].doc();
+
+        if (cursors[0].doc() == pivotDoc && accept && !accept(pivotDoc)) {
+            // Filtered out: step every cursor past pivotDoc without scoring it
+            for (auto& c : cursors) {
+                if (c.doc() != pivotDoc) break;
+                ++c.pos;
+            }
+        } else if (cursors[0].doc() == pivotDoc) {
+            // Every cursor positioned on pivotDoc contributes; score it exactly
+            float dot = 0.0f;
+            for (auto& c : cursors) {
+                if (c.doc() != pivotDoc) break;
+                dot += c.queryWeight * c.list->weights[c.pos];
+                ++c.pos;
+            }
+
+            float score = dot;
+            if (scoring == Scoring::Cosine) {
+                float rowNormSq = rowSquaredNorms ? (*rowSquaredNorms)[pivotDoc] : 1.0f;
+                score = rowNormSq > 0.0f ? dot / (queryNorm * std::sqrt(rowNormSq)) : 0.0f;
+            }
+
+            if (score >= minScore) heap.offer(pivotDoc, score);
+        } else {
+            // Documents before pivotDoc cannot qualify: skip the lagging cursors forward
+            for (size_t i = 0; i < pivot; ++i) {
+                auto& c = cursors[i];
+                const auto& docs = c.list->docs;
+                size_t lo = c.pos, hi = docs.size();
+                while (lo < hi) {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (docs[mid] < pivotDoc) lo = mid + 1;
+                    else hi = mid;
+                }
+                c.pos = lo;
+            }
+        }
+
+        cursors.erase(std::remove_if(cursors.begin(), cursors.end(),
+                          [](const Cursor& c) { return c.pos >= c.list->docs.size(); }),
+                      cursors.end());
+    }
+
+    return heap.take();
+}
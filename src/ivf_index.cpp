@@ -0,0 +1,208 @@
+#include "../include/ivf_index.h"
+#include "../include/simd_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <random>
+
+void IvfIndex::setParams(const Params& params) {
+    bool relist = params.nlist != settings.nlist;
+    settings = params;
+    settings.nprobe = std::max<size_t>(1, settings.nprobe);
+    if (relist) clear();
+}
+
+void IvfIndex::clearLists() {
+    size_t lists = members.size();
+    members.clear();
+    members.resize(lists);
+    assignment.clear();
+}
+
+void IvfIndex::clear() {
+    centroids = EmbeddingMatrix();
+    centroidNorms.clear();
+    members.clear();
+    assignment.clear();
+}
+
+void IvfIndex::scoreCentroids(const ScoreCentroids& score, float* out) const {
+    for (size_t c = 0; c < centroids.rows(); c += centroids.contiguousRows(c)) {
+        RowBlock block;
+        block.data = centroids.row(c).data();
+        block.stride = centroids.stride();
+        block.dim = centroids.dim();
+        block.count = centroids.contiguousRows(c);
+        block.squaredNorms = centroidNorms.data() + c;
+        score(block, out + c);
+    }
+}
+
+void IvfIndex::updateNorms() {
+    centroidNorms.resize(centroids.rows());
+    for (size_t c = 0; c < centroids.rows(); ++c) {
+        auto r = centroids.row(c);
+        centroidNorms[c] = SimdKernels::dot(r.data(), r.data(), r.size());
+    }
+}
+
+// ------------------------------------------------------------------
+// Training / assignment
+// ------------------------------------------------------------------
+std::vector<uint32_t> IvfIndex::assign(size_t rows, const ScoreRows& score) const {
+    std::vector<uint32_t> best(rows, 0);
+    std::vector<float> bestScore(rows, -std::numeric_limits<float>::infinity());
+    std::vector<float> scores(rows);
+
+    // Centroid-major so each callback scores every row against one centroid
+    for (size_t c = 0; c < centroids.rows(); ++c) {
+        score(centroids.row(c), 0, rows, scores.data());
+        for (size_t r = 0; r < rows; ++r) {
+            if (scores[r] > bestScore[r]) {
+                bestScore[r] = scores[r];
+                best[r] = static_cast<uint32_t>(c);
+            }
+        }
+    }
+    return best;
+}
+
+void IvfIndex::train(size_t rows, size_t dim, const AccumulateRow& accumulate,
+                     const ScoreRows& score) {
+    clear();
+    if (rows == 0 || dim == 0) return;
+
+    size_t k = settings.nlist ? settings.nlist
+                              : static_cast<size_t>(std::sqrt(static_cast<double>(rows)) + 0.5);
+    k = std::clamp<size_t>(k, 1, rows);
+
+    // Seed with k distinct rows picked by a fixed-seed shuffle
+    std::vector<uint32_t> order(rows);
+    std::iota(order.begin(), order.end(), 0u);
+    std::shuffle(order.begin(), order.end(), std::mt19937(0x1eaf));
+
+    centroids = EmbeddingMatrix(dim);
+    std::vector<float> buffer(dim);
+    for (size_t c = 0; c < k; ++c) {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        accumulate(order[c], buffer);
+        centroids.appendRow(buffer);
+    }
+    updateNorms();
+
+    std::vector<uint32_t> current;
+    std::vector<float> sums(k * dim);
+    std::vector<size_t> counts(k);
+    for (size_t it = 0; it < settings.iterations; ++it) {
+        auto next = assign(rows, score);
+        if (next == current) break;
+        current = std::move(next);
+
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t r = 0; r < rows; ++r) {
+            accumulate(static_cast<uint32_t>(r), { sums.data() + current[r] * dim, dim });
+            ++counts[current[r]];
+        }
+
+        // Empty lists keep their previous centroid
+        for (size_t c = 0; c < k; ++c) {
+            if (counts[c] == 0) continue;
+            auto centroid = centroids.mutableRow(c);
+            float inv = 1.0f / static_cast<float>(counts[c]);
+            for (size_t d = 0; d < dim; ++d) centroid[d] = sums[c * dim + d] * inv;
+        }
+        updateNorms();
+    }
+
+    auto best = assign(rows, score);
+    members.resize(k);
+    for (size_t r = 0; r < rows; ++r) {
+        assignment.push_back(best[r]);
+        members.mutableRow(best[r])->push_back(static_cast<uint32_t>(r));
+    }
+}
+
+void IvfIndex::add(const ScoreCentroids& score) {
+    if (!trained()) return;
+    uint32_t row = static_cast<uint32_t>(size());
+
+    std::vector<float> scores(centroids.rows());
+    scoreCentroids(score, scores.data());
+    auto best = static_cast<uint32_t>(std::max_element(scores.begin(), scores.end()) - scores.begin());
+
+    assignment.push_back(best);
+    members.mutableRow(best)->push_back(row);
+}
+
+void IvfIndex::reassign(uint32_t row, const ScoreCentroids& score) {
+    if (!trained() || row >= assignment.size()) return;
+    auto& old = *members.mutableRow(assignment[row]);
+    old.erase(std::remove(old.begin(), old.end(), row), old.end());
+
+    std::vector<float> scores(centroids.rows());
+    scoreCentroids(score, scores.data());
+    auto best = static_cast<uint32_t>(std::max_element(scores.begin(), scores.end()) - scores.begin());
+    assignment.set(row, best);
+    members.mutableRow(best)->push_back(row);
+}
+
+// ------------------------------------------------------------------
+// Query
+// ------------------------------------------------------------------
+std::vector<uint32_t> IvfIndex::probe(const ScoreCentroids& score) const {
+    if (!trained()) return {};
+
+    std::vector<float> scores(centroids.rows());
+    scoreCentroids(score, scores.data());
+
+    std::vector<uint32_t> ids(centroids.rows());
+    std::iota(ids.begin(), ids.end(), 0u);
+    size_t n = std::min(settings.nprobe, ids.size());
+    std::partial_sort(ids.begin(), ids.begin() + n, ids.end(),
+                      [&](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+    ids.resize(n);
+    return ids;
+}
+
+// ------------------------------------------------------------------
+// Persistence
+// ------------------------------------------------------------------
+bool IvfIndex::write(std::ostream& out) const {
+    uint64_t header[4] = { settings.nlist, settings.nprobe, settings.iterations, assignment.size() };
+    out.write(reinterpret_cast<const char*>(&FILE_MAGIC), sizeof(FILE_MAGIC));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    assignment.writeRows(out);
+    return centroids.write(out);
+}
+
+bool IvfIndex::read(std::istream& in) {
+    uint32_t magic = 0;
+    uint64_t header[4] = {};
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in || magic != FILE_MAGIC) return false;
+
+    clear();
+    settings.nlist = header[0];
+    settings.nprobe = std::max<uint64_t>(1, header[1]);
+    settings.iterations = header[2];
+    if (!assignment.readRows(in, header[3]) || !centroids.read(in)) {
+        clear();
+        return false;
+    }
+
+    members.resize(centroids.rows());
+    for (size_t r = 0; r < assignment.size(); ++r) {
+        if (assignment[r] >= members.size()) {
+            clear();
+            return false;
+        }
+        members.mutableRow(assignment[r])->push_back(static_cast<uint32_t>(r));
+    }
+    updateNorms();
+    return true;
+}
@@ -0,0 +1,151 @@
+#include "../include/quantized_matrix.h"
+#include "../include/simd_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <ostream>
+
+namespace {
+constexpr float CODE_MAX = 127.0f;
+}
+
+void QuantizedMatrix::setLayout(size_t dim, Encoding encoding) {
+    format = encoding;
+    dimension = dim;
+    rowStride = (dim * valueBytes() + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+    codes = SharedRows<uint16_t>(rowStride / sizeof(uint16_t));
+}
+
+void QuantizedMatrix::train(const EmbeddingMatrix& rows, Encoding encoding) {
+    clear();
+    size_t dim = rows.dim();
+    if (dim == 0) return;
+    if (encoding != Encoding::Int8) {
+        setLayout(dim, encoding);
+        return;
+    }
+    if (rows.empty()) return;
+
+    std::vector<float> lo(dim), hi(dim);
+    auto first = rows.row(0);
+    std::copy(first.begin(), first.end(), lo.begin());
+    std::copy(first.begin(), first.end(), hi.begin());
+    for (size_t i = 1; i < rows.rows(); ++i) {
+        auto r = rows.row(i);
+        for (size_t d = 0; d < dim; ++d) {
+            lo[d] = std::min(lo[d], r[d]);
+            hi[d] = std::max(hi[d], r[d]);
+        }
+    }
+
+    // Codes -127..127 span [lo, hi]; the midpoint is code 0
+    scale.resize(dim);
+    offset.resize(dim);
+    for (size_t d = 0; d < dim; ++d) {
+        scale[d] = (hi[d] - lo[d]) / (2.0f * CODE_MAX);
+        offset[d] = 0.5f * (lo[d] + hi[d]);
+    }
+    setLayout(dim, encoding);
+}
+
+size_t QuantizedMatrix::appendRow(std::span<const float> values) {
+    codes.appendRow();
+    setRow(rows() - 1, values);
+    return rows() - 1;
+}
+
+void QuantizedMatrix::setRow(size_t i, std::span<const float> values) {
+    uint8_t* out = reinterpret_cast<uint8_t*>(codes.mutableRow(i));
+    if (format == Encoding::Int8) {
+        auto* code = reinterpret_cast<int8_t*>(out);
+        for (size_t d = 0; d < dim(); ++d) {
+            float v = d < values.size() ? values[d] : 0.0f;   // zero-pad short rows
+            float q = scale[d] > 0.0f ? std::round((v - offset[d]) / scale[d]) : 0.0f;
+            code[d] = static_cast<int8_t>(std::clamp(q, -CODE_MAX, CODE_MAX));
+        }
+        return;
+    }
+
+    const float* in = values.data();
+    if (values.size() < dim()) {
+        thread_local std::vector<float> padded;
+        padded.assign(dim(), 0.0f);
+        std::copy(values.begin(), values.end(), padded.begin());
+        in = padded.data();
+    }
+    auto* half = reinterpret_cast<uint16_t*>(out);
+    if (format == Encoding::Float16) {
+        SimdKernels::floatToHalf(in, half, dim());
+    } else {
+        SimdKernels::floatToBf16(in, half, dim());
+    }
+}
+
+void QuantizedMatrix::decode(size_t begin, size_t count, float* out, size_t outStride) const {
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* r = row(begin + i);
+        float* dst = out + i * outStride;
+        switch (format) {
+        case Encoding::Int8:
+            SimdKernels::dequantizeInt8(reinterpret_cast<const int8_t*>(r), scale.data(),
+                                        offset.data(), dst, dim());
+            break;
+        case Encoding::Float16:
+            SimdKernels::halfToFloat(reinterpret_cast<const uint16_t*>(r), dst, dim());
+            break;
+        case Encoding::BFloat16:
+            SimdKernels::bf16ToFloat(reinterpret_cast<const uint16_t*>(r), dst, dim());
+            break;
+        }
+    }
+}
+
+void QuantizedMatrix::keepRows(const std::vector<uint8_t>& keep) {
+    codes.keepRows(keep);
+}
+
+void QuantizedMatrix::clearRows() {
+    codes.clear();
+}
+
+void QuantizedMatrix::clear() {
+    clearRows();
+    scale.clear();
+    offset.clear();
+    dimension = 0;
+    rowStride = 0;
+}
+
+// ------------------------------------------------------------------
+// Persistence: dim, rows, scale and offset (Int8 only), then all codes
+// in one copy
+// ------------------------------------------------------------------
+bool QuantizedMatrix::write(std::ostream& out) const {
+    uint64_t header[2] = { dim(), rows() };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(scale.data()), scale.size() * sizeof(float));
+    out.write(reinterpret_cast<const char*>(offset.data()), offset.size() * sizeof(float));
+    return codes.writeRows(out);
+}
+
+bool QuantizedMatrix::read(std::istream& in, Encoding encoding) {
+    uint64_t header[2] = {};
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in) return false;
+
+    clear();
+    size_t dim = header[0];
+    setLayout(dim, encoding);
+    if (encoding == Encoding::Int8) {
+        scale.resize(dim);
+        offset.resize(dim);
+    }
+
+    in.read(reinterpret_cast<char*>(scale.data()), scale.size() * sizeof(float));
+    in.read(reinterpret_cast<char*>(offset.data()), offset.size() * sizeof(float));
+    if (!in || !codes.readRows(in, header[1])) {
+        clear();
+        return false;
+    }
+    return true;
+}
@@ -6,9 +6,7 @@
 #include <fstream>
 #include <sstream>
 #include <regex>
-#include <algorithm>
 #include <filesystem>
-#include <mutex>
 #include <iomanip>
 
 namespace fs = std::filesystem;
@@ -33,25 +31,22 @@ RAGPipeline::RAGPipeline(std::unique_ptr<EmbeddingEngine> eng, IndexManager* idx
 std::vector<CodeChunk> RAGPipeline::retrieveRelevant(
     const std::string& query, 
     const std::vector<int>& errorLines, 
-    int topK) 
+    int topK,
+    const SearchFilter& filter)
 {
     std::vector<CodeChunk> matches;
 
     int effectiveTopK = config ? config->max_results : topK;
 
-    std::shared_lock lock(chunksMutex);
-    const auto& chunks = indexManager->getChunks();
+    // Search and resolve against one snapshot; a concurrent reindex
+    // publishes a new one without touching this
+    auto snap = indexManager->snapshot();
+    if (snap->chunks.empty()) return matches;
 
-    if (chunks.empty()) return matches;
+    auto results = snap->retrieveChunks(query, effectiveTopK, filter);
 
-    // Use helper function in IndexManager to access VectorStore
-    auto results = indexManager->retrieveChunks(query, effectiveTopK);
-
-    for (const auto& [text, score] : results) {
-        auto it = std::find_if(chunks.begin(), chunks.end(),
-                               [&text](const CodeChunk& c){ return c.code == text; });
-        if (it != chunks.end()) matches.push_back(*it);
-    }
+    matches.reserve(results.size());
+    for (const auto& hit : results) matches.push_back(*snap->chunks[hit.chunk]);
 
     return matches;
 }
@@ -60,25 +55,21 @@ std::vector<CodeChunk> RAGPipeline::retrieveRelevant(
 std::string RAGPipeline::query(const std::string& queryStr) {
     if (!indexManager) return "[No IndexManager available]";
 
-    auto results = indexManager->retrieveChunks(queryStr, 5);
+    auto snap = indexManager->snapshot();
+    auto results = snap->retrieveChunks(queryStr, 5);
     if (results.empty()) return "[No relevant context found]";
 
     std::ostringstream oss;
-    const auto& chunks = indexManager->getChunks();
+    const auto& chunks = snap->chunks;
 
     for (size_t i = 0; i < results.size(); ++i) {
-        const auto& [text, score] = results[i];
-        auto it = std::find_if(chunks.begin(), chunks.end(),
-                               [&](const CodeChunk& c) { return c.code == text; });
-        if (it != chunks.end()) {
-            const auto& chunk = *it;
-            oss << "=== Chunk " << (i + 1) << " (score: " 
-                << std::fixed << std::setprecision(3) << score << ") ===\n";
-            oss << "File: " << fs::path(chunk.fileName).filename() << "\n";
-            if (!chunk.symbolName.empty()) oss << "Symbol: " << chunk.symbolName << "\n";
-            if (chunk.startLine > 0) oss << "Lines: " << chunk.startLine << "-" << chunk.endLine << "\n";
-            oss << "Content:\n" << limitText(text, 400) << "\n\n";
-        }
+        const auto& chunk = *chunks[results[i].chunk];
+        oss << "=== Chunk " << (i + 1) << " (score: " 
+            << std::fixed << std::setprecision(3) << results[i].score << ") ===\n";
+        oss << "File: " << fs::path(chunk.fileName).filename() << "\n";
+        if (!chunk.symbolName.empty()) oss << "Symbol: " << chunk.symbolName << "\n";
+        if (chunk.startLine > 0) oss << "Lines: " << chunk.startLine << "-" << chunk.endLine << "\n";
+        oss << "Content:\n" << limitText(chunk.code, 400) << "\n\n";
     }
 
     return oss.str();
@@ -86,7 +77,6 @@ std::string RAGPipeline::query(const std::string& queryStr) {
 
 // Clear all data
 void RAGPipeline::clear() {
-    std::shared_lock lock(chunksMutex);
     if (indexManager) indexManager->clear();
 }
 
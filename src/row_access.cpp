@@ -0,0 +1,62 @@
+#include "../include/row_access.h"
+#include <algorithm>
+#include <atomic>
+
+namespace {
+std::atomic<uint64_t> accessClock{ 1 };
+}
+
+uint64_t RowAccessLog::tick() {
+    return accessClock.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RowAccessLog::append() {
+    lastHits.push_back(tick());
+    hitCounts.push_back(0);
+}
+
+void RowAccessLog::record(uint32_t row, uint64_t now) const {
+    if (row >= lastHits.size()) return;
+    std::atomic_ref<uint64_t>(lastHits[row].value).store(now, std::memory_order_relaxed);
+    std::atomic_ref<uint32_t>(hitCounts[row].value).fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t RowAccessLog::lastHit(size_t row) const {
+    return lastHits[row].load();
+}
+
+uint32_t RowAccessLog::hits(size_t row) const {
+    return hitCounts[row].load();
+}
+
+std::vector<uint32_t> RowAccessLog::coldestFirst(Policy policy) const {
+    // Read each counter once so the sort sees a consistent key
+    struct Key {
+        uint32_t hits;
+        uint64_t last;
+        uint32_t row;
+    };
+    std::vector<Key> keys(rows());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = { policy == Policy::Lfu ? hits(i) : 0u, lastHit(i), static_cast<uint32_t>(i) };
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+        if (a.hits != b.hits) return a.hits < b.hits;
+        if (a.last != b.last) return a.last < b.last;
+        return a.row < b.row;
+    });
+
+    std::vector<uint32_t> order(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) order[i] = keys[i].row;
+    return order;
+}
+
+void RowAccessLog::keepRows(const std::vector<uint8_t>& keep) {
+    lastHits.keepRows(keep);
+    hitCounts.keepRows(keep);
+}
+
+void RowAccessLog::clear() {
+    lastHits.clear();
+    hitCounts.clear();
+}
@@ -0,0 +1,193 @@
+#include "../include/row_metadata.h"
+#include <algorithm>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+
+uint32_t MetadataColumns::Dictionary::find(const std::string& value) const {
+    auto it = ids.find(value);
+    return it == ids.end() ? NOT_INTERNED : it->second;
+}
+
+void MetadataColumns::Dictionary::clear() {
+    values.assign(1, "");
+    ids = { { "", 0 } };
+}
+
+uint32_t MetadataColumns::intern(std::shared_ptr<Dictionary>& dictionary, const std::string& value) {
+    uint32_t id = dictionary->find(value);
+    if (id != NOT_INTERNED) return id;
+    Dictionary& own = unshare(dictionary);
+    id = static_cast<uint32_t>(own.values.size());
+    own.values.push_back(value);
+    own.ids.emplace(value, id);
+    return id;
+}
+
+void MetadataColumns::append(const RowMetadata& meta) {
+    fileIds.push_back(intern(files, meta.file));
+    symbolIds.push_back(intern(symbols, meta.symbol));
+    startLines.push_back(meta.startLine);
+    endLines.push_back(meta.endLine);
+    timestamps.push_back(meta.timestamp);
+    deleted.push_back(0);
+}
+
+void MetadataColumns::set(size_t row, const RowMetadata& meta) {
+    if (row >= rows()) return;
+    fileIds.set(row, intern(files, meta.file));
+    symbolIds.set(row, intern(symbols, meta.symbol));
+    startLines.set(row, meta.startLine);
+    endLines.set(row, meta.endLine);
+    timestamps.set(row, meta.timestamp);
+}
+
+RowMetadata MetadataColumns::get(size_t row) const {
+    RowMetadata meta;
+    if (row >= rows()) return meta;
+    meta.file = files->values[fileIds[row]];
+    meta.symbol = symbols->values[symbolIds[row]];
+    meta.startLine = startLines[row];
+    meta.endLine = endLines[row];
+    meta.timestamp = timestamps[row];
+    return meta;
+}
+
+void MetadataColumns::markDeleted(size_t row) {
+    if (row >= rows() || deleted[row]) return;
+    deleted.set(row, 1);
+    ++deletedCount;
+}
+
+// Leaves the dropped rows' strings interned; they are few and may be reused
+void MetadataColumns::keepRows(const std::vector<uint8_t>& keep) {
+    fileIds.keepRows(keep);
+    symbolIds.keepRows(keep);
+    startLines.keepRows(keep);
+    endLines.keepRows(keep);
+    timestamps.keepRows(keep);
+    deleted.keepRows(keep);
+    deletedCount = 0;
+    for (uint8_t d : deleted) deletedCount += d;
+}
+
+void MetadataColumns::clear() {
+    files = std::make_shared<Dictionary>();
+    files->clear();
+    symbols = std::make_shared<Dictionary>();
+    symbols->clear();
+    fileIds.clear();
+    symbolIds.clear();
+    startLines.clear();
+    endLines.clear();
+    timestamps.clear();
+    deleted.clear();
+    deletedCount = 0;
+}
+
+// ------------------------------------------------------------------
+// Filtering: string predicates run once per distinct file / symbol
+// ------------------------------------------------------------------
+static bool underPath(const std::string& file, const std::string& prefix) {
+    if (prefix.empty()) return true;
+    if (file.compare(0, prefix.size(), prefix) != 0) return false;
+    // Whole path components only: "src" matches "src/a.h", not "srcgen/a.h"
+    return file.size() == prefix.size() || prefix.back() == '/' || file[prefix.size()] == '/';
+}
+
+MetadataColumns::RowFilter MetadataColumns::compile(const SearchFilter& filter) const {
+    RowFilter f;
+    f.columns = this;
+    f.minLine = filter.minLine;
+    f.maxLine = filter.maxLine;
+    f.modifiedAfter = filter.modifiedAfter;
+
+    f.fileOk.resize(files->values.size());
+    for (size_t id = 0; id < files->values.size(); ++id) {
+        const std::string& file = files->values[id];
+        bool ok = underPath(file, filter.pathPrefix);
+        if (ok && !filter.extensions.empty()) {
+            std::string ext = std::filesystem::path(file).extension().string();
+            ok = std::find(filter.extensions.begin(), filter.extensions.end(), ext)
+                 != filter.extensions.end();
+        }
+        f.fileOk[id] = ok;
+    }
+
+    f.symbolOk.resize(symbols->values.size());
+    for (size_t id = 0; id < symbols->values.size(); ++id) {
+        f.symbolOk[id] = filter.symbol.empty()
+                      || symbols->values[id].find(filter.symbol) != std::string::npos;
+    }
+
+    if (filter.empty()) {
+        f.matchCount = rows() - deletedCount;
+    } else {
+        for (size_t row = 0; row < rows(); ++row) f.matchCount += f.allows(row);
+    }
+    return f;
+}
+
+// ------------------------------------------------------------------
+// Persistence: both dictionaries, then each column in one copy
+// ------------------------------------------------------------------
+static void writeStrings(std::ostream& out, const std::vector<std::string>& values) {
+    uint64_t count = values.size();
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& v : values) {
+        uint64_t len = v.size();
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(v.data(), len);
+    }
+}
+
+static bool readStrings(std::istream& in, std::vector<std::string>& values) {
+    uint64_t count = 0;
+    if (!in.read(reinterpret_cast<char*>(&count), sizeof(count))) return false;
+    values.clear();
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t len = 0;
+        if (!in.read(reinterpret_cast<char*>(&len), sizeof(len))) return false;
+        std::string v(len, '\0');
+        if (!in.read(v.data(), len)) return false;
+        values.push_back(std::move(v));
+    }
+    return true;
+}
+
+bool MetadataColumns::write(std::ostream& out) const {
+    writeStrings(out, files->values);
+    writeStrings(out, symbols->values);
+    uint64_t count = rows();
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    fileIds.writeRows(out);
+    symbolIds.writeRows(out);
+    startLines.writeRows(out);
+    endLines.writeRows(out);
+    return timestamps.writeRows(out);
+}
+
+bool MetadataColumns::read(std::istream& in) {
+    clear();
+    std::vector<std::string> fileValues, symbolValues;
+    uint64_t count = 0;
+    bool ok = readStrings(in, fileValues) && readStrings(in, symbolValues)
+           && in.read(reinterpret_cast<char*>(&count), sizeof(count))
+           && fileIds.readRows(in, count) && symbolIds.readRows(in, count)
+           && startLines.readRows(in, count) && endLines.readRows(in, count)
+           && timestamps.readRows(in, count);
+
+    if (ok) {
+        for (const auto& v : fileValues) intern(files, v);
+        for (const auto& v : symbolValues) intern(symbols, v);
+        ok = files->values.size() == fileValues.size() && symbols->values.size() == symbolValues.size()
+          && std::all_of(fileIds.begin(), fileIds.end(),
+                         [&](uint32_t id) { return id < files->values.size(); })
+          && std::all_of(symbolIds.begin(), symbolIds.end(),
+                         [&](uint32_t id) { return id < symbols->values.size(); });
+    }
+    deleted.resize(fileIds.size());
+    deletedCount = 0;
+    if (!ok) clear();
+    return ok;
+}
@@ -0,0 +1,701 @@
+#include "../include/simd_kernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_KERNELS_X86 1
+#endif
+
+namespace {
+
+// ------------------------------------------------------------------
+// Scalar fallback (four independent accumulators to hide FP latency)
+// ------------------------------------------------------------------
+float dotScalar(const float* a, const float* b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+float squaredDistanceScalar(const float* a, const float* b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float d0 = a[i] - b[i];
+        float d1 = a[i + 1] - b[i + 1];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+    }
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        s0 += d * d;
+    }
+    return s0 + s1;
+}
+
+void dotAndNormsScalar(const float* a, const float* b, size_t n,
+                       float& dot, float& normA, float& normB) {
+    float d = 0.0f, na = 0.0f, nb = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        d += a[i] * b[i];
+        na += a[i] * a[i];
+        nb += b[i] * b[i];
+    }
+    dot = d;
+    normA = na;
+    normB = nb;
+}
+
+void dequantizeInt8Scalar(const int8_t* codes, const float* scale, const float* offset,
+                          float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = offset[i] + scale[i] * static_cast<float>(codes[i]);
+}
+
+// IEEE binary16 and bfloat16, round to nearest even like F16C/AVX512-BF16.
+// NaNs stay (quiet) NaNs; floats past the fp16 range become infinity.
+uint16_t floatToHalf1(float f) {
+    constexpr uint32_t F32_INF = 255u << 23;
+    constexpr uint32_t F16_OVERFLOW = (127u + 16u) << 23;   // 2^16 and up
+    constexpr uint32_t F16_NORMAL_MIN = 113u << 23;         // 2^-14
+    constexpr uint32_t DENORM_MAGIC = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint16_t h;
+    if (x >= F16_OVERFLOW) {
+        h = x > F32_INF ? 0x7e00 : 0x7c00;
+    } else if (x < F16_NORMAL_MIN) {
+        // Adding 0.5 shifts the subnormal's bits into place and rounds
+        float magic, v;
+        std::memcpy(&magic, &DENORM_MAGIC, sizeof(magic));
+        std::memcpy(&v, &x, sizeof(v));
+        v += magic;
+        std::memcpy(&x, &v, sizeof(x));
+        h = static_cast<uint16_t>(x - DENORM_MAGIC);
+    } else {
+        uint32_t mantissaOdd = (x >> 13) & 1u;
+        x += ((15u - 127u) << 23) + 0xfffu + mantissaOdd;
+        h = static_cast<uint16_t>(x >> 13);
+    }
+    return static_cast<uint16_t>(h | (sign >> 16));
+}
+
+float halfToFloat1(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+    uint32_t exponent = (h >> 10) & 0x1fu;
+    uint32_t mantissa = h & 0x3ffu;
+    uint32_t x;
+    if (exponent == 0x1fu) {
+        x = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        x = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    } else {
+        float v = static_cast<float>(mantissa) * 0x1p-24f;   // zero or subnormal
+        std::memcpy(&x, &v, sizeof(x));
+        x |= sign;
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+uint16_t floatToBf16_1(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffffu) > 0x7f800000u) return static_cast<uint16_t>((x >> 16) | 0x40u);
+    x += 0x7fffu + ((x >> 16) & 1u);
+    return static_cast<uint16_t>(x >> 16);
+}
+
+float bf16ToFloat1(uint16_t h) {
+    uint32_t x = static_cast<uint32_t>(h) << 16;
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+void floatToHalfScalar(const float* in, uint16_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = floatToHalf1(in[i]);
+}
+
+void halfToFloatScalar(const uint16_t* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = halfToFloat1(in[i]);
+}
+
+void floatToBf16Scalar(const float* in, uint16_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = floatToBf16_1(in[i]);
+}
+
+void bf16ToFloatScalar(const uint16_t* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = bf16ToFloat1(in[i]);
+}
+
+// Branch-free SWAR popcount; the tiers below use the POPCNT instruction
+uint32_t popcount64(uint64_t x) {
+    x -= (x >> 1) & 0x5555555555555555ull;
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<uint32_t>((x * 0x0101010101010101ull) >> 56);
+}
+
+void hammingDistancesScalar(const uint64_t* query, const uint64_t* codes, size_t words,
+                            size_t count, uint32_t* out) {
+    for (size_t r = 0; r < count; ++r) {
+        const uint64_t* code = codes + r * words;
+        uint32_t d = 0;
+        for (size_t w = 0; w < words; ++w) d += popcount64(query[w] ^ code[w]);
+        out[r] = d;
+    }
+}
+
+#ifdef SIMD_KERNELS_X86
+
+// ------------------------------------------------------------------
+// SSE4.1 (no FMA): 4 x 4-wide accumulators
+// ------------------------------------------------------------------
+__attribute__((target("sse4.1")))
+float hsum128(__m128 v) {
+    __m128 shuf = _mm_movehdup_ps(v);
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+__attribute__((target("sse4.1")))
+float dotSse4(const float* a, const float* b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i),      _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),  _mm_loadu_ps(b + i + 4)));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(a + i + 8),  _mm_loadu_ps(b + i + 8)));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12)));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float sum = hsum128(_mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+__attribute__((target("sse4.1")))
+float squaredDistanceSse4(const float* a, const float* b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i),     _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+    float sum = hsum128(_mm_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+__attribute__((target("sse4.1")))
+void dotAndNormsSse4(const float* a, const float* b, size_t n,
+                     float& dot, float& normA, float& normB) {
+    __m128 d = _mm_setzero_ps(), na = _mm_setzero_ps(), nb = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        d  = _mm_add_ps(d,  _mm_mul_ps(va, vb));
+        na = _mm_add_ps(na, _mm_mul_ps(va, va));
+        nb = _mm_add_ps(nb, _mm_mul_ps(vb, vb));
+    }
+    float sd = hsum128(d), sa = hsum128(na), sb = hsum128(nb);
+    for (; i < n; ++i) {
+        sd += a[i] * b[i];
+        sa += a[i] * a[i];
+        sb += b[i] * b[i];
+    }
+    dot = sd;
+    normA = sa;
+    normB = sb;
+}
+
+__attribute__((target("sse4.1")))
+void dequantizeInt8Sse4(const int8_t* codes, const float* scale, const float* offset,
+                        float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int32_t packed;
+        std::memcpy(&packed, codes + i, sizeof(packed));
+        __m128 c = _mm_cvtepi32_ps(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(packed)));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(offset + i),
+                                          _mm_mul_ps(_mm_loadu_ps(scale + i), c)));
+    }
+    for (; i < n; ++i) out[i] = offset[i] + scale[i] * static_cast<float>(codes[i]);
+}
+
+__attribute__((target("sse4.1,popcnt")))
+void hammingDistancesPopcnt(const uint64_t* query, const uint64_t* codes, size_t words,
+                            size_t count, uint32_t* out) {
+    for (size_t r = 0; r < count; ++r) {
+        const uint64_t* code = codes + r * words;
+        uint64_t d0 = 0, d1 = 0;
+        size_t w = 0;
+        for (; w + 2 <= words; w += 2) {
+            d0 += __builtin_popcountll(query[w] ^ code[w]);
+            d1 += __builtin_popcountll(query[w + 1] ^ code[w + 1]);
+        }
+        if (w < words) d0 += __builtin_popcountll(query[w] ^ code[w]);
+        out[r] = static_cast<uint32_t>(d0 + d1);
+    }
+}
+
+// ------------------------------------------------------------------
+// AVX2 + FMA: 4 x 8-wide accumulators
+// ------------------------------------------------------------------
+__attribute__((target("avx2,fma")))
+float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    __m128 shuf = _mm_movehdup_ps(lo);
+    __m128 sums = _mm_add_ps(lo, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+__attribute__((target("avx2,fma")))
+float dotAvx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),      _mm256_loadu_ps(b + i),      acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),  _mm256_loadu_ps(b + i + 8),  acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    float sum = hsum256(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+float squaredDistanceAvx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i),     _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+    }
+    float sum = hsum256(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+void dotAndNormsAvx2(const float* a, const float* b, size_t n,
+                     float& dot, float& normA, float& normB) {
+    __m256 d = _mm256_setzero_ps(), na = _mm256_setzero_ps(), nb = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        d  = _mm256_fmadd_ps(va, vb, d);
+        na = _mm256_fmadd_ps(va, va, na);
+        nb = _mm256_fmadd_ps(vb, vb, nb);
+    }
+    float sd = hsum256(d), sa = hsum256(na), sb = hsum256(nb);
+    for (; i < n; ++i) {
+        sd += a[i] * b[i];
+        sa += a[i] * a[i];
+        sb += b[i] * b[i];
+    }
+    dot = sd;
+    normA = sa;
+    normB = sb;
+}
+
+__attribute__((target("avx2,fma")))
+void dequantizeInt8Avx2(const int8_t* codes, const float* scale, const float* offset,
+                        float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes + i));
+        __m256 c = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes));
+        _mm256_storeu_ps(out + i, _mm256_fmadd_ps(_mm256_loadu_ps(scale + i), c,
+                                                  _mm256_loadu_ps(offset + i)));
+    }
+    for (; i < n; ++i) out[i] = offset[i] + scale[i] * static_cast<float>(codes[i]);
+}
+
+
+// F16C does the fp16 conversions; bf16 is integer rounding on the bits
+__attribute__((target("avx2,fma,f16c")))
+void floatToHalfF16c(const float* in, uint16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+    for (; i < n; ++i) out[i] = floatToHalf1(in[i]);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+void halfToFloatF16c(const uint16_t* in, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+    for (; i < n; ++i) out[i] = halfToFloat1(in[i]);
+}
+
+__attribute__((target("avx2,fma")))
+void floatToBf16Avx2(const float* in, uint16_t* out, size_t n) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i bias = _mm256_set1_epi32(0x7fff);
+    const __m256i quiet = _mm256_set1_epi32(0x40);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(in + i);
+        __m256i x = _mm256_castps_si256(v);
+        __m256i upper = _mm256_srli_epi32(x, 16);
+        __m256i rounded = _mm256_srli_epi32(
+            _mm256_add_epi32(_mm256_add_epi32(x, bias), _mm256_and_si256(upper, one)), 16);
+        __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        __m256i h = _mm256_blendv_epi8(rounded, _mm256_or_si256(upper, quiet), nan);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    for (; i < n; ++i) out[i] = floatToBf16_1(in[i]);
+}
+
+__attribute__((target("avx2,fma")))
+void bf16ToFloatAvx2(const uint16_t* in, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m256i x = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+        _mm256_storeu_ps(out + i, _mm256_castsi256_ps(x));
+    }
+    for (; i < n; ++i) out[i] = bf16ToFloat1(in[i]);
+}
+
+// ------------------------------------------------------------------
+// AVX-512F: 4 x 16-wide accumulators, masked tail
+// ------------------------------------------------------------------
+__attribute__((target("avx512f")))
+float dotAvx512(const float* a, const float* b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i),      _mm512_loadu_ps(b + i),      acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+        acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), acc2);
+        acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), acc3);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    if (i < n) {
+        __mmask16 m = static_cast<__mmask16>((1u << (n - i)) - 1);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx512f")))
+float squaredDistanceAvx512(const float* a, const float* b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i),      _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d, d, acc0);
+    }
+    if (i < n) {
+        __mmask16 m = static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i));
+        acc1 = _mm512_fmadd_ps(d, d, acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+void dotAndNormsAvx512(const float* a, const float* b, size_t n,
+                       float& dot, float& normA, float& normB) {
+    __m512 d = _mm512_setzero_ps(), na = _mm512_setzero_ps(), nb = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 va = _mm512_loadu_ps(a + i);
+        __m512 vb = _mm512_loadu_ps(b + i);
+        d  = _mm512_fmadd_ps(va, vb, d);
+        na = _mm512_fmadd_ps(va, va, na);
+        nb = _mm512_fmadd_ps(vb, vb, nb);
+    }
+    if (i < n) {
+        __mmask16 m = static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 va = _mm512_maskz_loadu_ps(m, a + i);
+        __m512 vb = _mm512_maskz_loadu_ps(m, b + i);
+        d  = _mm512_fmadd_ps(va, vb, d);
+        na = _mm512_fmadd_ps(va, va, na);
+        nb = _mm512_fmadd_ps(vb, vb, nb);
+    }
+    dot = _mm512_reduce_add_ps(d);
+    normA = _mm512_reduce_add_ps(na);
+    normB = _mm512_reduce_add_ps(nb);
+}
+
+__attribute__((target("avx512f")))
+void dequantizeInt8Avx512(const int8_t* codes, const float* scale, const float* offset,
+                          float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+        __m512 c = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(bytes));
+        _mm512_storeu_ps(out + i, _mm512_fmadd_ps(_mm512_loadu_ps(scale + i), c,
+                                                  _mm512_loadu_ps(offset + i)));
+    }
+    for (; i < n; ++i) out[i] = offset[i] + scale[i] * static_cast<float>(codes[i]);
+}
+
+
+__attribute__((target("avx512f")))
+void floatToHalfAvx512(const float* in, uint16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), h);
+    }
+    for (; i < n; ++i) out[i] = floatToHalf1(in[i]);
+}
+
+__attribute__((target("avx512f")))
+void halfToFloatAvx512(const uint16_t* in, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm512_storeu_ps(out + i, _mm512_cvtph_ps(h));
+    }
+    for (; i < n; ++i) out[i] = halfToFloat1(in[i]);
+}
+
+__attribute__((target("avx512f")))
+void floatToBf16Avx512(const float* in, uint16_t* out, size_t n) {
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i bias = _mm512_set1_epi32(0x7fff);
+    const __m512i quiet = _mm512_set1_epi32(0x40);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_loadu_ps(in + i);
+        __m512i x = _mm512_castps_si512(v);
+        __m512i upper = _mm512_srli_epi32(x, 16);
+        __m512i rounded = _mm512_srli_epi32(
+            _mm512_add_epi32(_mm512_add_epi32(x, bias), _mm512_and_si512(upper, one)), 16);
+        __mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+        __m512i h = _mm512_mask_blend_epi32(nan, rounded, _mm512_or_si512(upper, quiet));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_cvtepi32_epi16(h));
+    }
+    for (; i < n; ++i) out[i] = floatToBf16_1(in[i]);
+}
+
+// AVX512-BF16 rounds in one instruction (subnormal inputs flush to zero)
+__attribute__((target("avx512f,avx512bf16")))
+void floatToBf16Avx512Bf16(const float* in, uint16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), reinterpret_cast<__m256i&>(h));
+    }
+    for (; i < n; ++i) out[i] = floatToBf16_1(in[i]);
+}
+
+__attribute__((target("avx512f")))
+void bf16ToFloatAvx512(const uint16_t* in, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m512i x = _mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16);
+        _mm512_storeu_ps(out + i, _mm512_castsi512_ps(x));
+    }
+    for (; i < n; ++i) out[i] = bf16ToFloat1(in[i]);
+}
+
+// AVX512-VPOPCNTDQ counts eight words per instruction
+__attribute__((target("avx512f,avx512vpopcntdq")))
+void hammingDistancesAvx512(const uint64_t* query, const uint64_t* codes, size_t words,
+                            size_t count, uint32_t* out) {
+    for (size_t r = 0; r < count; ++r) {
+        const uint64_t* code = codes + r * words;
+        __m512i acc = _mm512_setzero_si512();
+        size_t w = 0;
+        for (; w + 8 <= words; w += 8) {
+            __m512i x = _mm512_xor_si512(_mm512_loadu_si512(query + w), _mm512_loadu_si512(code + w));
+            acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+        }
+        if (w < words) {
+            __mmask8 m = static_cast<__mmask8>((1u << (words - w)) - 1);
+            __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi64(m, query + w),
+                                         _mm512_maskz_loadu_epi64(m, code + w));
+            acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+        }
+        out[r] = static_cast<uint32_t>(_mm512_reduce_add_epi64(acc));
+    }
+}
+
+#endif // SIMD_KERNELS_X86
+
+// ------------------------------------------------------------------
+// Dispatch
+// ------------------------------------------------------------------
+struct KernelTable {
+    const char* name;
+    float (*dot)(const float*, const float*, size_t);
+    float (*squaredDistance)(const float*, const float*, size_t);
+    void (*dotAndNorms)(const float*, const float*, size_t, float&, float&, float&);
+    void (*dequantizeInt8)(const int8_t*, const float*, const float*, float*, size_t);
+    void (*floatToHalf)(const float*, uint16_t*, size_t);
+    void (*halfToFloat)(const uint16_t*, float*, size_t);
+    void (*floatToBf16)(const float*, uint16_t*, size_t);
+    void (*bf16ToFloat)(const uint16_t*, float*, size_t);
+    void (*hammingDistances)(const uint64_t*, const uint64_t*, size_t, size_t, uint32_t*);
+};
+
+constexpr KernelTable SCALAR_TABLE{"scalar", dotScalar, squaredDistanceScalar, dotAndNormsScalar,
+                                   dequantizeInt8Scalar, floatToHalfScalar, halfToFloatScalar,
+                                   floatToBf16Scalar, bf16ToFloatScalar, hammingDistancesScalar};
+#ifdef SIMD_KERNELS_X86
+constexpr KernelTable SSE4_TABLE{"sse4", dotSse4, squaredDistanceSse4, dotAndNormsSse4,
+                                 dequantizeInt8Sse4, floatToHalfScalar, halfToFloatScalar,
+                                 floatToBf16Scalar, bf16ToFloatScalar, hammingDistancesPopcnt};
+constexpr KernelTable AVX2_TABLE{"avx2", dotAvx2, squaredDistanceAvx2, dotAndNormsAvx2,
+                                 dequantizeInt8Avx2, floatToHalfF16c, halfToFloatF16c,
+                                 floatToBf16Avx2, bf16ToFloatAvx2, hammingDistancesPopcnt};
+constexpr KernelTable AVX512_TABLE{"avx512", dotAvx512, squaredDistanceAvx512, dotAndNormsAvx512,
+                                   dequantizeInt8Avx512, floatToHalfAvx512, halfToFloatAvx512,
+                                   floatToBf16Avx512, bf16ToFloatAvx512, hammingDistancesPopcnt};
+#endif
+
+// Tiers ordered best-first; an override can only select a tier the CPU supports
+KernelTable selectKernels() {
+    const char* forced = std::getenv("BASIC_AGENT_SIMD");
+    if (forced != nullptr && *forced == '\0') forced = nullptr;
+    auto allowed = [forced](const char* name) {
+        return forced == nullptr || std::strcmp(forced, name) == 0;
+    };
+
+#ifdef SIMD_KERNELS_X86
+    __builtin_cpu_init();
+    if (allowed("avx512") && __builtin_cpu_supports("avx512f")) {
+        KernelTable table = AVX512_TABLE;
+        if (__builtin_cpu_supports("avx512bf16")) table.floatToBf16 = floatToBf16Avx512Bf16;
+        if (__builtin_cpu_supports("avx512vpopcntdq")) table.hammingDistances = hammingDistancesAvx512;
+        return table;
+    }
+    if (allowed("avx2") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        KernelTable table = AVX2_TABLE;
+        if (!__builtin_cpu_supports("popcnt")) table.hammingDistances = hammingDistancesScalar;
+        if (!__builtin_cpu_supports("f16c")) {
+            table.floatToHalf = floatToHalfScalar;
+            table.halfToFloat = halfToFloatScalar;
+        }
+        return table;
+    }
+    if (allowed("sse4") && __builtin_cpu_supports("sse4.1")) {
+        KernelTable table = SSE4_TABLE;
+        if (!__builtin_cpu_supports("popcnt")) table.hammingDistances = hammingDistancesScalar;
+        return table;
+    }
+#endif
+    if (forced != nullptr && std::strcmp(forced, "scalar") != 0) {
+        std::cerr << "[SimdKernels] Requested ISA '" << forced
+                  << "' not available, using scalar kernels\n";
+    }
+    return SCALAR_TABLE;
+}
+
+// Resolved during static initialization, before main()
+const KernelTable kernels = selectKernels();
+
+} // namespace
+
+namespace SimdKernels {
+
+float dot(const float* a, const float* b, size_t n) {
+    return kernels.dot(a, b, n);
+}
+
+float squaredDistance(const float* a, const float* b, size_t n) {
+    return kernels.squaredDistance(a, b, n);
+}
+
+void dotAndNorms(const float* a, const float* b, size_t n,
+                 float& dot, float& normA, float& normB) {
+    kernels.dotAndNorms(a, b, n, dot, normA, normB);
+}
+
+void dequantizeInt8(const int8_t* codes, const float* scale, const float* offset,
+                    float* out, size_t n) {
+    kernels.dequantizeInt8(codes, scale, offset, out, n);
+}
+
+void floatToHalf(const float* in, uint16_t* out, size_t n) {
+    kernels.floatToHalf(in, out, n);
+}
+
+void halfToFloat(const uint16_t* in, float* out, size_t n) {
+    kernels.halfToFloat(in, out, n);
+}
+
+void floatToBf16(const float* in, uint16_t* out, size_t n) {
+    kernels.floatToBf16(in, out, n);
+}
+
+void bf16ToFloat(const uint16_t* in, float* out, size_t n) {
+    kernels.bf16ToFloat(in, out, n);
+}
+
+void hammingDistances(const uint64_t* query, const uint64_t* codes, size_t words,
+                      size_t count, uint32_t* out) {
+    kernels.hammingDistances(query, codes, words, count, out);
+}
+
+const char* activeIsa() {
+    return kernels.name;
+}
+
+} // namespace SimdKernels
@@ -1,56 +1,399 @@
 // src/similarity.cpp
 #include "../include/similarity.h"
+#include "../include/simd_kernels.h"
 #include <cmath>
 #include <algorithm>
+#include <limits>
 #include <unordered_set>
 
+namespace {
+constexpr float NEG_INF = -std::numeric_limits<float>::infinity();
+// Query floats per pruning stripe (four cache lines)
+constexpr size_t PRUNE_STRIPE = 64;
+// Share of |query|^2 left unread once the heaviest stripes are scored
+constexpr float PRUNE_TAIL_SHARE = 0.25f;
+// Relative slack on a bound, so rounding never drops a row that qualifies
+constexpr float PRUNE_SLACK = 1e-5f;
+
+// A contiguous slice of the query and its share of |query|^2
+struct QueryStripe {
+    size_t begin;
+    size_t size;
+    float normSq;
+};
+}
+
+// Default batch path: one virtual call per row
+void ISimilarity::scoreBlock(std::span<const float> query,
+                             const RowBlock& rows, float* out) const {
+    for (size_t i = 0; i < rows.count; ++i) {
+        out[i] = (*this)(query, rows.row(i));
+    }
+}
+
+// Default sparse paths: densify and reuse the dense operator()
+float ISimilarity::operator()(SparseRowView a, SparseRowView b) const {
+    if (a.nnz() == 0 || b.nnz() == 0) return 0.0f;
+    size_t dim = std::max(a.indices.back(), b.indices.back()) + size_t{1};
+    std::vector<float> da(dim), db(dim);
+    SparseKernels::scatter(a, da);
+    SparseKernels::scatter(b, db);
+    return (*this)(std::span<const float>(da), std::span<const float>(db));
+}
+
+void ISimilarity::scoreSparseBlock(SparseRowView query, std::span<const float>,
+                                   const SparseRowBlock& rows, float* out) const {
+    for (size_t i = 0; i < rows.count; ++i) {
+        out[i] = (*this)(query, rows.row(i));
+    }
+}
+
+// Row norm from the block cache when present
+static float sparseRowNormSq(const SparseRowBlock& rows, size_t i) {
+    if (rows.unitNorm) return 1.0f;
+    return rows.squaredNorms ? rows.squaredNorms[i] : SparseKernels::squaredNorm(rows.row(i));
+}
+
+// Scores the rows keep() admits, in runs of consecutive rows; the others
+// report -infinity
+template <typename Keep>
+static void scoreSparseRuns(const ISimilarity& sim, SparseRowView query,
+                            std::span<const float> denseQuery, const SparseRowBlock& rows,
+                            const Keep& keep, float* out) {
+    auto scoreRun = [&](size_t first, size_t count) {
+        SparseRowBlock run = rows;
+        run.offsets = rows.offsets + first;
+        run.count = count;
+        if (rows.squaredNorms) run.squaredNorms = rows.squaredNorms + first;
+        sim.scoreSparseBlock(query, denseQuery, run, out + first);
+    };
+    size_t runStart = 0;
+    for (size_t i = 0; i < rows.count; ++i) {
+        if (keep(i)) continue;
+        if (i > runStart) scoreRun(runStart, i - runStart);
+        out[i] = NEG_INF;
+        runStart = i + 1;
+    }
+    if (rows.count > runStart) scoreRun(runStart, rows.count - runStart);
+}
+
+// ------------------------------------------------------------------
+// Pruned scoring
+// ------------------------------------------------------------------
+float ISimilarity::minDotFor(float, float, float) const {
+    return NEG_INF;
+}
+
+void ISimilarity::scoreBlockAbove(std::span<const float> query, const RowBlock& rows,
+                                  float minScore, float* out) const {
+    size_t len = std::min(query.size(), rows.dim);
+    bool norms = rows.unitNorm || rows.squaredNorms;
+    if (!boundedByDot() || minScore == NEG_INF || !norms || len == 0 || len != rows.dim) {
+        scoreBlock(query, rows, out);
+        return;
+    }
+
+    // Heaviest stripes first: the unread part of the query shrinks fastest,
+    // and with it the bound on what the rest of a row can add
+    thread_local std::vector<QueryStripe> stripes;
+    stripes.clear();
+    float queryNormSq = 0.0f;
+    for (size_t b = 0; b < len; b += PRUNE_STRIPE) {
+        size_t n = std::min(PRUNE_STRIPE, len - b);
+        float e = SimdKernels::dot(query.data() + b, query.data() + b, n);
+        stripes.push_back({ b, n, e });
+        queryNormSq += e;
+    }
+    std::sort(stripes.begin(), stripes.end(),
+              [](const QueryStripe& a, const QueryStripe& b) { return a.normSq > b.normSq; });
+
+    // The head is the fewest stripes leaving at most PRUNE_TAIL_SHARE of the
+    // query unread. Reading it first only pays when it is at most half the
+    // row; a query with its weight spread evenly just gets the norm bound.
+    size_t head = 0;
+    float tailNormSq = queryNormSq;
+    while (head < stripes.size() && tailNormSq > PRUNE_TAIL_SHARE * queryNormSq) {
+        tailNormSq -= stripes[head++].normSq;
+    }
+    bool readHead = head * 2 <= stripes.size();
+
+    // Unit rows share one bound: the block is all in or all out by norm
+    if (rows.unitNorm) {
+        float need = minDotFor(minScore, queryNormSq, 1.0f);
+        float slack = PRUNE_SLACK * (1.0f + std::sqrt(queryNormSq));
+        if (std::sqrt(queryNormSq) + slack < need) {
+            std::fill(out, out + rows.count, NEG_INF);
+            return;
+        }
+        if (!readHead || need == NEG_INF) {
+            scoreBlock(query, rows, out);
+            return;
+        }
+    }
+
+    auto scoreRun = [&](size_t first, size_t count) {
+        RowBlock run = rows;
+        run.data = rows.data + first * rows.stride;
+        run.count = count;
+        if (rows.squaredNorms) run.squaredNorms = rows.squaredNorms + first;
+        scoreBlock(query, run, out + first);
+    };
+
+    size_t runStart = 0;
+    for (size_t i = 0; i < rows.count; ++i) {
+        float rowNormSq = rows.unitNorm ? 1.0f : rows.squaredNorms[i];
+        float need = minDotFor(minScore, queryNormSq, rowNormSq);
+        float slack = PRUNE_SLACK * (1.0f + std::sqrt(queryNormSq * rowNormSq));
+
+        // |a·b| <= |a||b|, first for the whole row, then for its unread part
+        bool pruned = std::sqrt(queryNormSq * rowNormSq) + slack < need;
+        if (!pruned && readHead && need > NEG_INF) {
+            const float* r = rows.data + i * rows.stride;
+            float dot = 0.0f, queryRest = queryNormSq, rowRest = rowNormSq;
+            for (size_t s = 0; s < head && !pruned; ++s) {
+                float d, queryPart, rowPart;
+                SimdKernels::dotAndNorms(query.data() + stripes[s].begin, r + stripes[s].begin,
+                                         stripes[s].size, d, queryPart, rowPart);
+                dot += d;
+                queryRest -= stripes[s].normSq;
+                rowRest -= rowPart;
+                pruned = dot + std::sqrt(std::max(0.0f, queryRest) * std::max(0.0f, rowRest))
+                       + slack < need;
+            }
+        }
+        if (pruned) {
+            // Rows still in the bound are scored in runs with the metric's
+            // own kernel, so their scores match the unpruned scan exactly
+            if (i > runStart) scoreRun(runStart, i - runStart);
+            out[i] = NEG_INF;
+            runStart = i + 1;
+        }
+    }
+    if (rows.count > runStart) scoreRun(runStart, rows.count - runStart);
+}
+
+// Sparse rows cost O(nnz) already, so only the norm bound is applied; rows
+// that pass are scored in runs to keep the virtual calls per block low
+void ISimilarity::scoreSparseBlockAbove(SparseRowView query, std::span<const float> denseQuery,
+                                        const SparseRowBlock& rows, float minScore,
+                                        float* out) const {
+    if (!boundedByDot() || minScore == NEG_INF) {
+        scoreSparseBlock(query, denseQuery, rows, out);
+        return;
+    }
+
+    float queryNormSq = SparseKernels::squaredNorm(query);
+    if (rows.unitNorm) {
+        float slack = PRUNE_SLACK * (1.0f + std::sqrt(queryNormSq));
+        if (std::sqrt(queryNormSq) + slack < minDotFor(minScore, queryNormSq, 1.0f)) {
+            std::fill(out, out + rows.count, NEG_INF);
+        } else {
+            scoreSparseBlock(query, denseQuery, rows, out);
+        }
+        return;
+    }
+
+    auto keep = [&](size_t i) {
+        float rowNormSq = sparseRowNormSq(rows, i);
+        float slack = PRUNE_SLACK * (1.0f + std::sqrt(queryNormSq * rowNormSq));
+        return std::sqrt(queryNormSq * rowNormSq) + slack
+            >= minDotFor(minScore, queryNormSq, rowNormSq);
+    };
+    scoreSparseRuns(*this, query, denseQuery, rows, keep, out);
+}
+
 // Cosine
-float CosineSimilarity::operator()(const std::vector<float>& a,
-                                   const std::vector<float>& b) const {
+float CosineSimilarity::operator()(std::span<const float> a,
+                                   std::span<const float> b) const {
     if (a.empty() || b.empty()) return 0.0f;
     size_t len = std::min(a.size(), b.size());
 
-    double dot = 0.0, normA = 0.0, normB = 0.0;
-    for (size_t i = 0; i < len; ++i) {
-        dot += static_cast<double>(a[i]) * b[i];
-        normA += static_cast<double>(a[i]) * a[i];
-        normB += static_cast<double>(b[i]) * b[i];
+    float dot = 0.0f, normA = 0.0f, normB = 0.0f;
+    SimdKernels::dotAndNorms(a.data(), b.data(), len, dot, normA, normB);
+
+    if (normA == 0.0f || normB == 0.0f) return 0.0f;
+    return dot / (std::sqrt(normA) * std::sqrt(normB));
+}
+
+void CosineSimilarity::scoreBlock(std::span<const float> query,
+                                  const RowBlock& rows, float* out) const {
+    size_t len = std::min(query.size(), rows.dim);
+    if (len == 0) {
+        std::fill(out, out + rows.count, 0.0f);
+        return;
     }
 
-    if (normA == 0.0 || normB == 0.0) return 0.0f;
-    return static_cast<float>(dot / (std::sqrt(normA) * std::sqrt(normB)));
+    float queryNorm = std::sqrt(SimdKernels::dot(query.data(), query.data(), len));
+    if (queryNorm == 0.0f) {
+        std::fill(out, out + rows.count, 0.0f);
+        return;
+    }
+
+    // Unit rows: cosine is the dot product scaled by the query norm alone
+    if (rows.unitNorm && len == rows.dim) {
+        float invQueryNorm = 1.0f / queryNorm;
+        for (size_t i = 0; i < rows.count; ++i) {
+            out[i] = SimdKernels::dot(query.data(), rows.data + i * rows.stride, len) * invQueryNorm;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < rows.count; ++i) {
+        const float* r = rows.data + i * rows.stride;
+        float dot, rowNormSq;
+        // Cached norms only hold when the whole row takes part in the product
+        if (rows.squaredNorms && len == rows.dim) {
+            dot = SimdKernels::dot(query.data(), r, len);
+            rowNormSq = rows.squaredNorms[i];
+        } else {
+            float unused;
+            SimdKernels::dotAndNorms(query.data(), r, len, dot, unused, rowNormSq);
+        }
+        out[i] = (rowNormSq == 0.0f) ? 0.0f : dot / (queryNorm * std::sqrt(rowNormSq));
+    }
+}
+
+float CosineSimilarity::operator()(SparseRowView a, SparseRowView b) const {
+    float normA = SparseKernels::squaredNorm(a);
+    float normB = SparseKernels::squaredNorm(b);
+    if (normA == 0.0f || normB == 0.0f) return 0.0f;
+    return SparseKernels::dot(a, b) / (std::sqrt(normA) * std::sqrt(normB));
+}
+
+void CosineSimilarity::scoreSparseBlock(SparseRowView query, std::span<const float> denseQuery,
+                                        const SparseRowBlock& rows, float* out) const {
+    float queryNorm = std::sqrt(SparseKernels::squaredNorm(query));
+    if (rows.unitNorm && queryNorm > 0.0f) {
+        float invQueryNorm = 1.0f / queryNorm;
+        for (size_t i = 0; i < rows.count; ++i) {
+            out[i] = SparseKernels::dot(rows.row(i), denseQuery) * invQueryNorm;
+        }
+        return;
+    }
+    for (size_t i = 0; i < rows.count; ++i) {
+        float rowNormSq = sparseRowNormSq(rows, i);
+        if (queryNorm == 0.0f || rowNormSq == 0.0f) {
+            out[i] = 0.0f;
+            continue;
+        }
+        out[i] = SparseKernels::dot(rows.row(i), denseQuery) / (queryNorm * std::sqrt(rowNormSq));
+    }
+}
+
+// score >= minScore  <=>  a·b >= minScore |a||b|
+float CosineSimilarity::minDotFor(float minScore, float normSqA, float normSqB) const {
+    if (normSqA == 0.0f || normSqB == 0.0f) {
+        return minScore > 0.0f ? std::numeric_limits<float>::infinity() : NEG_INF;
+    }
+    return minScore * std::sqrt(normSqA) * std::sqrt(normSqB);
 }
 
 // Euclidean
-float EuclideanSimilarity::operator()(const std::vector<float>& a,
-                                      const std::vector<float>& b) const {
+float EuclideanSimilarity::operator()(std::span<const float> a,
+                                      std::span<const float> b) const {
     if (a.empty() || b.empty()) return 0.0f;
     size_t len = std::min(a.size(), b.size());
 
-    double sumSq = 0.0;
-    for (size_t i = 0; i < len; ++i) {
-        double diff = static_cast<double>(a[i]) - b[i];
-        sumSq += diff * diff;
-    }
+    float sumSq = SimdKernels::squaredDistance(a.data(), b.data(), len);
     return 1.0f / (1.0f + std::sqrt(sumSq)); // normalized similarity
 }
 
+void EuclideanSimilarity::scoreBlock(std::span<const float> query,
+                                     const RowBlock& rows, float* out) const {
+    size_t len = std::min(query.size(), rows.dim);
+    if (len == 0) {
+        std::fill(out, out + rows.count, 0.0f);
+        return;
+    }
+
+    // Unit rows: |q - r|^2 = |q|^2 + 1 - 2 q.r (2 - 2 q.r for a unit query)
+    if (rows.unitNorm && len == rows.dim) {
+        float queryNormSq = SimdKernels::dot(query.data(), query.data(), len);
+        for (size_t i = 0; i < rows.count; ++i) {
+            float dot = SimdKernels::dot(query.data(), rows.data + i * rows.stride, len);
+            float sumSq = std::max(0.0f, queryNormSq + 1.0f - 2.0f * dot);
+            out[i] = 1.0f / (1.0f + std::sqrt(sumSq));
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < rows.count; ++i) {
+        float sumSq = SimdKernels::squaredDistance(query.data(), rows.data + i * rows.stride, len);
+        out[i] = 1.0f / (1.0f + std::sqrt(sumSq));
+    }
+}
+
+float EuclideanSimilarity::operator()(SparseRowView a, SparseRowView b) const {
+    if (a.nnz() == 0 || b.nnz() == 0) return 0.0f;
+    // |a - b|^2 = |a|^2 + |b|^2 - 2 a.b, clamped against rounding
+    float sumSq = SparseKernels::squaredNorm(a) + SparseKernels::squaredNorm(b)
+                - 2.0f * SparseKernels::dot(a, b);
+    return 1.0f / (1.0f + std::sqrt(std::max(0.0f, sumSq)));
+}
+
+void EuclideanSimilarity::scoreSparseBlock(SparseRowView query, std::span<const float> denseQuery,
+                                           const SparseRowBlock& rows, float* out) const {
+    float queryNormSq = SparseKernels::squaredNorm(query);
+    for (size_t i = 0; i < rows.count; ++i) {
+        SparseRowView r = rows.row(i);
+        if (query.nnz() == 0 || r.nnz() == 0) {
+            out[i] = 0.0f;
+            continue;
+        }
+        float sumSq = queryNormSq + sparseRowNormSq(rows, i)
+                    - 2.0f * SparseKernels::dot(r, denseQuery);
+        out[i] = 1.0f / (1.0f + std::sqrt(std::max(0.0f, sumSq)));
+    }
+}
+
+// 1 / (1 + d) >= s  <=>  d^2 = |a|^2 + |b|^2 - 2 a·b <= (1/s - 1)^2
+float EuclideanSimilarity::minDotFor(float minScore, float normSqA, float normSqB) const {
+    if (minScore <= 0.0f) return NEG_INF;
+    if (minScore > 1.0f) return std::numeric_limits<float>::infinity();
+    float maxDistance = 1.0f / minScore - 1.0f;
+    return 0.5f * (normSqA + normSqB - maxDistance * maxDistance);
+}
+
 // Dot Product
-float DotProductSimilarity::operator()(const std::vector<float>& a,
-                                       const std::vector<float>& b) const {
+float DotProductSimilarity::operator()(std::span<const float> a,
+                                       std::span<const float> b) const {
     if (a.empty() || b.empty()) return 0.0f;
     size_t len = std::min(a.size(), b.size());
 
-    double dot = 0.0;
-    for (size_t i = 0; i < len; ++i) {
-        dot += static_cast<double>(a[i]) * b[i];
+    return SimdKernels::dot(a.data(), b.data(), len);
+}
+
+void DotProductSimilarity::scoreBlock(std::span<const float> query,
+                                      const RowBlock& rows, float* out) const {
+    size_t len = std::min(query.size(), rows.dim);
+    if (len == 0) {
+        std::fill(out, out + rows.count, 0.0f);
+        return;
     }
-    return static_cast<float>(dot);
+
+    for (size_t i = 0; i < rows.count; ++i) {
+        out[i] = SimdKernels::dot(query.data(), rows.data + i * rows.stride, len);
+    }
+}
+
+float DotProductSimilarity::operator()(SparseRowView a, SparseRowView b) const {
+    return SparseKernels::dot(a, b);
+}
+
+void DotProductSimilarity::scoreSparseBlock(SparseRowView, std::span<const float> denseQuery,
+                                            const SparseRowBlock& rows, float* out) const {
+    for (size_t i = 0; i < rows.count; ++i) {
+        out[i] = SparseKernels::dot(rows.row(i), denseQuery);
+    }
+}
+
+float DotProductSimilarity::minDotFor(float minScore, float, float) const {
+    return minScore;
 }
 
 // Jaccard (treats nonzero entries as set membership)
-float JaccardSimilarity::operator()(const std::vector<float>& a,
-                                    const std::vector<float>& b) const {
+float JaccardSimilarity::operator()(std::span<const float> a,
+                                    std::span<const float> b) const {
     if (a.empty() || b.empty()) return 0.0f;
     size_t len = std::min(a.size(), b.size());
 
@@ -66,3 +409,38 @@ float JaccardSimilarity::operator()(const std::vector<float>& a,
     return (unionCount > 0) ? static_cast<float>(intersection) / unionCount : 0.0f;
 }
 
+float JaccardSimilarity::operator()(SparseRowView a, SparseRowView b) const {
+    if (a.nnz() == 0 || b.nnz() == 0) return 0.0f;
+    size_t intersection = SparseKernels::intersectionCount(a, b);
+    size_t unionCount = a.nnz() + b.nnz() - intersection;
+    return (unionCount > 0) ? static_cast<float>(intersection) / unionCount : 0.0f;
+}
+
+void JaccardSimilarity::scoreSparseBlock(SparseRowView query, std::span<const float> denseQuery,
+                                         const SparseRowBlock& rows, float* out) const {
+    for (size_t i = 0; i < rows.count; ++i) {
+        SparseRowView r = rows.row(i);
+        if (query.nnz() == 0 || r.nnz() == 0) {
+            out[i] = 0.0f;
+            continue;
+        }
+        size_t intersection = 0;
+        for (uint32_t idx : r.indices) {
+            if (denseQuery[idx] != 0.0f) ++intersection;
+        }
+        size_t unionCount = query.nnz() + r.nnz() - intersection;
+        out[i] = static_cast<float>(intersection) / unionCount;
+    }
+}
+
+void JaccardSimilarity::scoreSparseBlockAbove(SparseRowView query, std::span<const float> denseQuery,
+                                              const SparseRowBlock& rows, float minScore,
+                                              float* out) const {
+    size_t queryTerms = query.nnz();
+    auto keep = [&](size_t i) {
+        size_t rowTerms = rows.offsets[i + 1] - rows.offsets[i];
+        size_t hi = std::max(queryTerms, rowTerms);
+        return hi == 0 || static_cast<float>(std::min(queryTerms, rowTerms)) / hi >= minScore;
+    };
+    scoreSparseRuns(*this, query, denseQuery, rows, keep, out);
+}
@@ -0,0 +1,99 @@
+#include "../include/sparse_matrix.h"
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+bool SparseMatrix::setDimension(size_t dim) {
+    if (!empty() && dim != dimension) return false;
+    dimension = dim;
+    return true;
+}
+
+size_t SparseMatrix::appendRow(SparseRowView row) {
+    if (rowCount % BLOCK_ROWS == 0) blocks.push_back(std::make_shared<Block>());
+    Block& block = unshare(blocks.back());
+    for (size_t k = 0; k < row.nnz(); ++k) {
+        if (row.indices[k] >= dimension) continue;
+        block.indices.push_back(row.indices[k]);
+        block.values.push_back(row.values[k]);
+    }
+    entryCount += block.indices.size() - block.offsets.back();
+    block.offsets.push_back(block.indices.size());
+    return rowCount++;
+}
+
+void SparseMatrix::keepRows(const std::vector<uint8_t>& keep) {
+    SparseMatrix kept;
+    kept.dimension = dimension;
+    for (size_t i = 0; i < rowCount; ++i) {
+        if (i < keep.size() && !keep[i]) continue;
+        kept.appendRow(row(i));
+    }
+    *this = std::move(kept);
+}
+
+void SparseMatrix::clear() {
+    blocks.clear();
+    rowCount = 0;
+    entryCount = 0;
+}
+
+// ------------------------------------------------------------------
+// Persistence: header, then the offsets, indices and values of the whole
+// matrix as three arrays
+// ------------------------------------------------------------------
+bool SparseMatrix::write(std::ostream& out) const {
+    size_t numRows = rows();
+    size_t numNonZero = nnz();
+    out.write(reinterpret_cast<const char*>(&numRows), sizeof(numRows));
+    out.write(reinterpret_cast<const char*>(&dimension), sizeof(dimension));
+    out.write(reinterpret_cast<const char*>(&numNonZero), sizeof(numNonZero));
+    size_t offset = 0;
+    out.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    for (const auto& block : blocks) {
+        for (size_t r = 1; r < block->offsets.size(); ++r) {
+            size_t end = offset + block->offsets[r];
+            out.write(reinterpret_cast<const char*>(&end), sizeof(end));
+        }
+        offset += block->indices.size();
+    }
+    for (const auto& block : blocks) {
+        out.write(reinterpret_cast<const char*>(block->indices.data()), block->indices.size() * sizeof(uint32_t));
+    }
+    for (const auto& block : blocks) {
+        out.write(reinterpret_cast<const char*>(block->values.data()), block->values.size() * sizeof(float));
+    }
+    return static_cast<bool>(out);
+}
+
+bool SparseMatrix::read(std::istream& in) {
+    size_t numRows = 0, dim = 0, numNonZero = 0;
+    in.read(reinterpret_cast<char*>(&numRows), sizeof(numRows));
+    in.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+    in.read(reinterpret_cast<char*>(&numNonZero), sizeof(numNonZero));
+    // Row ids are 32-bit elsewhere in the store
+    if (!in || numRows >= UINT32_MAX) return false;
+
+    std::vector<size_t> offsets(numRows + 1);
+    std::vector<uint32_t> indices(numNonZero);
+    std::vector<float> values(numNonZero);
+    in.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(size_t));
+    in.read(reinterpret_cast<char*>(indices.data()), numNonZero * sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(values.data()), numNonZero * sizeof(float));
+
+    // Rows must tile [0, nnz) in order and every index must fit the
+    // dimension, or row() and the scans read out of bounds
+    bool valid = static_cast<bool>(in) && offsets.front() == 0 && offsets.back() == numNonZero;
+    for (size_t i = 1; valid && i < offsets.size(); ++i) valid = offsets[i - 1] <= offsets[i];
+    for (size_t k = 0; valid && k < numNonZero; ++k) valid = indices[k] < dim;
+    clear();
+    if (!valid) return false;
+
+    dimension = dim;
+    for (size_t i = 0; i < numRows; ++i) {
+        size_t b = offsets[i], e = offsets[i + 1];
+        appendRow({ { indices.data() + b, e - b }, { values.data() + b, e - b } });
+    }
+    return true;
+}
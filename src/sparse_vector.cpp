@@ -0,0 +1,99 @@
+#include "../include/sparse_vector.h"
+#include <algorithm>
+
+// ------------------------------------------------------------------
+// SparseVector
+// ------------------------------------------------------------------
+float SparseVector::squaredNorm() const {
+    return SparseKernels::squaredNorm(view());
+}
+
+std::vector<float> SparseVector::toDense() const {
+    std::vector<float> dense(dimension, 0.0f);
+    for (size_t k = 0; k < indices.size(); ++k) {
+        if (indices[k] < dimension) dense[indices[k]] = values[k];
+    }
+    return dense;
+}
+
+SparseVector SparseVector::fromDense(std::span<const float> dense) {
+    SparseVector vec;
+    vec.dimension = dense.size();
+    for (size_t i = 0; i < dense.size(); ++i) {
+        if (dense[i] != 0.0f) {
+            vec.indices.push_back(static_cast<uint32_t>(i));
+            vec.values.push_back(dense[i]);
+        }
+    }
+    return vec;
+}
+
+// ------------------------------------------------------------------
+// Kernels
+// ------------------------------------------------------------------
+namespace SparseKernels {
+
+float dot(SparseRowView a, SparseRowView b) {
+    float sum = 0.0f;
+    size_t i = 0, j = 0;
+    while (i < a.nnz() && j < b.nnz()) {
+        uint32_t ia = a.indices[i], ib = b.indices[j];
+        if (ia == ib) {
+            sum += a.values[i++] * b.values[j++];
+        } else if (ia < ib) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return sum;
+}
+
+float dot(SparseRowView a, std::span<const float> dense) {
+    const uint32_t* idx = a.indices.data();
+    const float* val = a.values.data();
+    const float* d = dense.data();
+    size_t n = a.nnz();
+
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        s0 += val[k] * d[idx[k]];
+        s1 += val[k + 1] * d[idx[k + 1]];
+        s2 += val[k + 2] * d[idx[k + 2]];
+        s3 += val[k + 3] * d[idx[k + 3]];
+    }
+    for (; k < n; ++k) s0 += val[k] * d[idx[k]];
+    return (s0 + s1) + (s2 + s3);
+}
+
+size_t intersectionCount(SparseRowView a, SparseRowView b) {
+    size_t count = 0;
+    size_t i = 0, j = 0;
+    while (i < a.nnz() && j < b.nnz()) {
+        uint32_t ia = a.indices[i], ib = b.indices[j];
+        if (ia == ib) {
+            ++count; ++i; ++j;
+        } else if (ia < ib) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return count;
+}
+
+float squaredNorm(SparseRowView a) {
+    float sum = 0.0f;
+    for (float v : a.values) sum += v * v;
+    return sum;
+}
+
+void scatter(SparseRowView a, std::span<float> dense) {
+    std::fill(dense.begin(), dense.end(), 0.0f);
+    for (size_t k = 0; k < a.nnz(); ++k) {
+        dense[a.indices[k]] = a.values[k];
+    }
+}
+
+} // namespace SparseKernels
@@ -0,0 +1,114 @@
+#include "../include/term_dictionary.h"
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+namespace {
+constexpr size_t MIN_SLOTS = 64;
+}
+
+// FNV-1a, folded to 32 bits; the table masks the low bits
+uint32_t TermDictionary::hashOf(std::string_view term) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : term) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+size_t TermDictionary::probe(std::string_view term, uint32_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t s = hash & mask;; s = (s + 1) & mask) {
+        uint32_t id = slots[s];
+        if (id == NO_TERM || (hashes[id] == hash && this->term(id) == term)) return s;
+    }
+}
+
+uint32_t TermDictionary::find(std::string_view term) const {
+    if (slots.empty()) return NO_TERM;
+    return slots[probe(term, hashOf(term))];
+}
+
+uint32_t TermDictionary::intern(std::string_view term) {
+    // At most half full, so probes stay short and always end
+    if ((size() + 1) * 2 > slots.size()) rehash(std::max(MIN_SLOTS, slots.size() * 2));
+
+    uint32_t hash = hashOf(term);
+    size_t s = probe(term, hash);
+    if (slots[s] != NO_TERM) return slots[s];
+
+    uint32_t id = static_cast<uint32_t>(size());
+    arena.insert(arena.end(), term.begin(), term.end());
+    offsets.push_back(static_cast<uint32_t>(arena.size()));
+    hashes.push_back(hash);
+    slots[s] = id;
+    return id;
+}
+
+void TermDictionary::rehash(size_t capacity) {
+    slots.assign(capacity, NO_TERM);
+    size_t mask = capacity - 1;
+    for (uint32_t id = 0; id < size(); ++id) {
+        size_t s = hashes[id] & mask;
+        while (slots[s] != NO_TERM) s = (s + 1) & mask;
+        slots[s] = id;
+    }
+}
+
+void TermDictionary::reserve(size_t terms) {
+    offsets.reserve(terms + 1);
+    hashes.reserve(terms);
+    size_t capacity = MIN_SLOTS;
+    while (capacity < terms * 2) capacity *= 2;
+    if (capacity > slots.size()) rehash(capacity);
+}
+
+void TermDictionary::clear() {
+    // Keeps the table's size so a dictionary refilled per text stops allocating
+    arena.clear();
+    offsets.assign(1, 0);
+    hashes.clear();
+    std::fill(slots.begin(), slots.end(), NO_TERM);
+}
+
+// ------------------------------------------------------------------
+// Persistence: magic, term count, arena size, offsets, arena. The hash
+// table is rebuilt on load.
+// ------------------------------------------------------------------
+bool TermDictionary::write(std::ostream& out) const {
+    uint64_t header[2] = { size(), arena.size() };
+    out.write(reinterpret_cast<const char*>(&FILE_MAGIC), sizeof(FILE_MAGIC));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    out.write(arena.data(), arena.size());
+    return static_cast<bool>(out);
+}
+
+bool TermDictionary::read(std::istream& in) {
+    uint32_t magic = 0;
+    uint64_t header[2] = {};
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in || magic != FILE_MAGIC || header[0] >= NO_TERM || header[1] > UINT32_MAX) return false;
+
+    clear();
+    offsets.resize(header[0] + 1);
+    arena.resize(header[1]);
+    in.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    in.read(arena.data(), arena.size());
+
+    bool valid = static_cast<bool>(in) && offsets.front() == 0 && offsets.back() == arena.size();
+    for (size_t i = 1; valid && i < offsets.size(); ++i) valid = offsets[i - 1] <= offsets[i];
+    if (!valid) {
+        clear();
+        return false;
+    }
+
+    hashes.resize(size());
+    for (uint32_t id = 0; id < size(); ++id) hashes[id] = hashOf(term(id));
+    size_t capacity = std::max(MIN_SLOTS, slots.size());
+    while (capacity < size() * 2) capacity *= 2;
+    rehash(capacity);
+    return true;
+}
@@ -0,0 +1,64 @@
+#include "../include/thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(threads - 1);
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void ThreadPool::parallelFor(size_t count, const Task& fn) {
+    std::unique_lock<std::mutex> busy(submitMutex, std::try_to_lock);
+    if (workers.empty() || count < 2 || !busy.owns_lock()) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        job = &fn;
+        jobCount = count;
+        nextIndex = 0;
+        activeWorkers = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    runTasks();
+
+    std::unique_lock<std::mutex> lock(mtx);
+    done.wait(lock, [this] { return activeWorkers == 0; });
+    job = nullptr;
+}
+
+// Claims indices until the loop is exhausted
+void ThreadPool::runTasks() {
+    for (size_t i = nextIndex++; i < jobCount; i = nextIndex++) (*job)(i);
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+
+        lock.unlock();
+        runTasks();
+        lock.lock();
+
+        if (--activeWorkers == 0) done.notify_one();
+    }
+}
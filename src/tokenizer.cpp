@@ -0,0 +1,110 @@
+#include "../include/tokenizer.h"
+#include <array>
+#include <cstdint>
+
+namespace {
+enum : uint8_t { LOWER = 1, UPPER = 2, DIGIT = 4, UNDERSCORE = 8, COLON = 16 };
+constexpr uint8_t ALNUM = LOWER | UPPER | DIGIT;
+constexpr uint8_t IDENT = ALNUM | UNDERSCORE;
+constexpr uint8_t SEPARATOR = UNDERSCORE | COLON;   // between identifier parts
+
+// One lookup classifies a byte; anything outside ASCII letters, digits,
+// '_' and ':' ends a word, as isalnum does in the "C" locale
+constexpr std::array<uint8_t, 256> CLASS = [] {
+    std::array<uint8_t, 256> table{};
+    for (int c = 'a'; c <= 'z'; ++c) table[c] = LOWER;
+    for (int c = 'A'; c <= 'Z'; ++c) table[c] = UPPER;
+    for (int c = '0'; c <= '9'; ++c) table[c] = DIGIT;
+    table['_'] = UNDERSCORE;
+    table[':'] = COLON;
+    return table;
+}();
+
+inline uint8_t classOf(char c) { return CLASS[static_cast<unsigned char>(c)]; }
+inline char lower(char c) { return (classOf(c) & UPPER) ? static_cast<char>(c | 0x20) : c; }
+}
+
+void Tokenizer::reset(std::string_view text) {
+    input = text;
+    // Grows only; words are written at their own offsets
+    if (lowered.size() < text.size()) lowered.resize(text.size());
+    pos = wordStart = wordEnd = partPos = 0;
+    parts = 0;
+}
+
+bool Tokenizer::next(std::string_view& term) {
+    for (;;) {
+        if (partPos < wordEnd) {
+            size_t end = partEnd(partPos);
+            term = { lowered.data() + partPos, end - partPos };
+            partPos = end;
+            while (partPos < wordEnd && (classOf(input[partPos]) & SEPARATOR)) ++partPos;
+            ++parts;
+            return true;
+        }
+        if (parts > 1) {
+            parts = 0;
+            term = { lowered.data() + wordStart, wordEnd - wordStart };
+            return true;
+        }
+
+        uint8_t starts = split ? IDENT : ALNUM;
+        while (pos < input.size() && !(classOf(input[pos]) & starts)) ++pos;
+        if (pos == input.size()) return false;
+
+        wordStart = pos;
+        wordEnd = pos = scanWord(pos);
+        parts = 0;
+        if (!split) {
+            partPos = wordEnd;
+            term = { lowered.data() + wordStart, wordEnd - wordStart };
+            return true;
+        }
+        partPos = wordStart;
+        while (partPos < wordEnd && (classOf(input[partPos]) & SEPARATOR)) ++partPos;
+    }
+}
+
+// End of the word starting at from, lowercasing it into the buffer.
+// Identifiers may contain '_' and "::" between parts (std::vector).
+size_t Tokenizer::scanWord(size_t from) {
+    uint8_t inside = split ? IDENT : ALNUM;
+    size_t i = from;
+    while (i < input.size()) {
+        char c = input[i];
+        if (classOf(c) & inside) {
+            lowered[i++] = lower(c);
+        } else if (split && c == ':' && i > from && i + 2 < input.size() && input[i + 1] == ':'
+                   && (classOf(input[i + 2]) & IDENT)) {
+            lowered[i++] = ':';
+            lowered[i++] = ':';
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+// End of the identifier part starting at from: a separator, a lower-case
+// letter or digit followed by a capital (parseHttp), or the last capital
+// of a run followed by a lower-case letter (HTTPRequest)
+size_t Tokenizer::partEnd(size_t from) const {
+    size_t i = from + 1;
+    for (; i < wordEnd; ++i) {
+        uint8_t cls = classOf(input[i]);
+        if (cls & SEPARATOR) break;
+        if (!(cls & UPPER)) continue;
+        uint8_t prev = classOf(input[i - 1]);
+        if (prev & (LOWER | DIGIT)) break;
+        if ((prev & UPPER) && i + 1 < wordEnd && (classOf(input[i + 1]) & LOWER)) break;
+    }
+    return i;
+}
+
+std::vector<std::string_view> Tokenizer::tokenize(std::string_view text) {
+    std::vector<std::string_view> terms;
+    reset(text);
+    std::string_view term;
+    while (next(term)) terms.push_back(term);
+    return terms;
+}
@@ -1,196 +1,1337 @@
 #include "vector_store.h"
+#include "simd_kernels.h"
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
-#include <queue>
+#include <limits>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <functional>
 #include <iostream>
 
 void VectorStore::setSimilarity(std::unique_ptr<ISimilarity> sim) {
-    if(sim) similarity = std::move(sim);
+    if (!sim) return;
+    similarity = std::move(sim);
+    // Graph links and list assignments were chosen under the old metric;
+    // IVF retrains on the next query
+    hnsw.clear();
+    ivf.clear();
+    syncAnnIndex();
 }
 
 
 void VectorStore::addDocument(const std::string& text) {
-    documents.push_back(text);
+    // A document added by text is part of the corpus the engine is fit on
+    embeddingEngine->partialFit(text);
+    if (embeddingEngine->producesSparse()) {
+        auto emb = embeddingEngine->embedSparse(text);
+        std::cerr << "[DEBUG] Sparse embedding generated, nnz=" << emb.nnz() << "\n";
+        if (emb.empty()) {
+            std::cerr << "[ERROR] Empty embedding for document! Text=\""
+                      << text.substr(0, 50) << (text.size() > 50 ? "..." : "")
+                      << "\"\n";
+        }
+        addDocument(text, emb);
+        fitted.set(fitted.size() - 1, 1);
+        return;
+    }
 
     auto emb = embeddingEngine->embed(text);
     std::cerr << "[DEBUG] Embedding generated, size=" << emb.size() << "\n";
 
     if (emb.empty()) {
-        std::cerr << "[ERROR] Empty embedding for document! Text=\"" 
-                  << text.substr(0, 50) << (text.size() > 50 ? "..." : "") 
+        std::cerr << "[ERROR] Empty embedding for document! Text=\""
+                  << text.substr(0, 50) << (text.size() > 50 ? "..." : "")
                   << "\"\n";
     }
 
-    embeddings.push_back(std::move(emb));
-    std::cerr << "[DEBUG] Added doc. Total docs=" << documents.size() 
-              << ", total embeddings=" << embeddings.size() << "\n";
+    addDocument(text, emb);
+    fitted.set(fitted.size() - 1, 1);
+}
+
+void VectorStore::addDocument(const std::string& text, const std::vector<float>& embedding) {
+    addDocument(std::make_shared<const std::string>(text), embedding);
+}
+
+void VectorStore::addDocument(const std::string& text, const SparseVector& embedding) {
+    addDocument(std::make_shared<const std::string>(text), embedding);
+}
+
+void VectorStore::addDocument(SharedText text, const std::vector<float>& embedding) {
+    // The first row with values fixes the store's layout and dimension
+    if (documents.empty() || (!embedding.empty() && rowDimension() == 0)) {
+        startLayout(Layout::Dense, embedding.size());
+    }
+
+    if (layout == Layout::Sparse) {
+        appendRow(SparseVector::fromDense(embedding));
+    } else {
+        appendRow(embedding);
+    }
+
+    pushDocument(std::move(text));
+    std::cerr << "[DEBUG] Added doc. Total docs=" << documents.size()
+              << ", total embeddings=" << squaredNorms.size() << "\n";
+}
+
+void VectorStore::addDocument(SharedText text, const SparseVector& embedding) {
+    if (documents.empty() || (!embedding.empty() && rowDimension() == 0)) {
+        startLayout(Layout::Sparse, embedding.dimension);
+    }
+
+    if (layout == Layout::Dense) {
+        appendRow(embedding.toDense());
+    } else {
+        appendRow(embedding);
+    }
+
+    pushDocument(std::move(text));
+    std::cerr << "[DEBUG] Added doc. Total docs=" << documents.size()
+              << ", total embeddings=" << squaredNorms.size() << "\n";
+}
+
+// Rows added so far had empty embeddings, so an empty first row leaves the
+// dimension at 0 rather than pinning it. Those rows hold no values and are
+// re-created as zero rows of the new dimension; text and metadata stay.
+void VectorStore::startLayout(Layout rowLayout, size_t dim) {
+    layout = rowLayout;
+    embeddings.clear();
+    sparseEmbeddings.clear();
+    quantized.clearRows();
+    invertedIndex.clear();
+    hnsw.clear();
+    ivf.clearLists();
+    binary.clearCodes();
+
+    squaredNorms.clear();
+    unitRows = true;
+
+    if (layout == Layout::Dense) {
+        embeddings.setDimension(dim);
+        // An encoding set up for another dimension no longer applies
+        if (dim > 0 && quantized.trained() && quantized.dim() != dim) quantized.clear();
+        for (size_t i = 0; i < documents.size(); ++i) appendRow(std::span<const float>());
+    } else {
+        sparseEmbeddings.setDimension(dim);
+        invertedIndex.setDimension(dim);
+        for (size_t i = 0; i < documents.size(); ++i) appendRow(SparseVector());
+    }
+}
+
+void VectorStore::appendRow(std::span<const float> embedding) {
+    if (!embedding.empty() && embedding.size() != embeddings.dim()) {
+        std::cerr << "[WARN] Embedding size " << embedding.size()
+                  << " != store dimension " << embeddings.dim()
+                  << "; padding/truncating.\n";
+    }
+    if (isQuantized()) {
+        std::vector<float> scratch;
+        auto r = denseRow(quantized.appendRow(embedding), scratch);
+        pushNorm(SimdKernels::dot(r.data(), r.data(), r.size()));
+    } else {
+        auto r = embeddings.row(embeddings.appendRow(embedding));
+        pushNorm(SimdKernels::dot(r.data(), r.data(), r.size()));
+        if (storage != Storage::Float32 && embeddings.rows() >= encodeMinRows()) quantizeRows();
+    }
+    if (searchIndex != SearchIndex::Flat) syncAnnIndex();
 }
 
+void VectorStore::appendRow(const SparseVector& embedding) {
+    if (!embedding.empty() && embedding.dimension != sparseEmbeddings.dim()) {
+        std::cerr << "[WARN] Embedding size " << embedding.dimension
+                  << " != store dimension " << sparseEmbeddings.dim()
+                  << "; dropping out-of-range entries.\n";
+    }
+    size_t row = sparseEmbeddings.appendRow(embedding.view());
+    pushNorm(SparseKernels::squaredNorm(sparseEmbeddings.row(row)));
+    invertedIndex.addDocument(static_cast<uint32_t>(row), sparseEmbeddings.row(row),
+                              squaredNorms.back());
+    if (searchIndex != SearchIndex::Flat) syncAnnIndex();
+}
+
+// Text and per-row bookkeeping for a row whose vector was just appended
+void VectorStore::pushDocument(SharedText text) {
+    documentBytes += textSize(text);
+    documents.push_back(std::move(text));
+    fitted.push_back(0);
+    metadata.append({});
+    access.append();
+}
+
+// A row addDocument(text) fitted leaves the engine's statistics with its text
+void VectorStore::unfitRow(size_t row) {
+    if (!fitted[row]) return;
+    if (documents[row]) embeddingEngine->unfit(*documents[row]);
+    fitted.set(row, 0);
+}
+
+void VectorStore::pushNorm(float squaredNorm) {
+    squaredNorms.push_back(squaredNorm);
+    unitRows = unitRows && std::fabs(squaredNorm - 1.0f) <= UNIT_NORM_TOLERANCE;
+}
+
+// Rebuilds the per-row derived state (norms, postings) after a bulk load.
+// Norms saved with the rows are adopted when there is one per row and
+// none is negative or non-finite; otherwise they are recomputed.
+void VectorStore::recomputeNorms(std::vector<float> savedNorms) {
+    size_t rows = layout == Layout::Sparse ? sparseEmbeddings.rows()
+                : isQuantized()            ? quantized.rows()
+                                           : embeddings.rows();
+    squaredNorms.clear();
+    unitRows = true;
+    bool adopt = savedNorms.size() == rows
+              && std::all_of(savedNorms.begin(), savedNorms.end(),
+                             [](float n) { return std::isfinite(n) && n >= 0.0f; });
+    if (adopt) {
+        for (float n : savedNorms) pushNorm(n);
+    } else if (layout == Layout::Sparse) {
+        for (size_t i = 0; i < rows; ++i) {
+            pushNorm(SparseKernels::squaredNorm(sparseEmbeddings.row(i)));
+        }
+    } else {
+        // Encoded rows use the norms of their decoded values so scores stay consistent
+        std::vector<float> scratch;
+        for (size_t i = 0; i < rows; ++i) {
+            auto r = denseRow(i, scratch);
+            pushNorm(SimdKernels::dot(r.data(), r.data(), r.size()));
+        }
+    }
+
+    if (layout == Layout::Sparse) {
+        invertedIndex.setDimension(sparseEmbeddings.dim());
+        for (size_t i = 0; i < rows; ++i) {
+            invertedIndex.addDocument(static_cast<uint32_t>(i), sparseEmbeddings.row(i),
+                                      squaredNorms[i]);
+        }
+    }
+}
+
+// ------------------------------------------------------------------
+// Int8 / fp16 / bf16 storage
+// ------------------------------------------------------------------
+namespace {
+QuantizedMatrix::Encoding encodingOf(VectorStore::Storage mode) {
+    switch (mode) {
+    case VectorStore::Storage::Float16:  return QuantizedMatrix::Encoding::Float16;
+    case VectorStore::Storage::BFloat16: return QuantizedMatrix::Encoding::BFloat16;
+    default:                             return QuantizedMatrix::Encoding::Int8;
+    }
+}
+
+const char* encodingName(QuantizedMatrix::Encoding encoding) {
+    switch (encoding) {
+    case QuantizedMatrix::Encoding::Float16:  return "fp16";
+    case QuantizedMatrix::Encoding::BFloat16: return "bf16";
+    default:                                  return "int8";
+    }
+}
+}
+
+void VectorStore::setStorage(Storage mode) {
+    storage = mode;
+    if (layout != Layout::Dense) return;
+
+    if (quantized.trained() && (mode == Storage::Float32 || quantized.encoding() != encodingOf(mode))) {
+        decodeRows();
+    }
+    if (mode != Storage::Float32 && !quantized.trained() && embeddings.rows() >= encodeMinRows()) {
+        quantizeRows();
+    }
+}
+
+size_t VectorStore::encodeMinRows() const {
+    return storage == Storage::Int8 ? QUANTIZE_MIN_ROWS : 1;
+}
+
+// Back to floats: decode what the codes hold (the rounding error stays)
+void VectorStore::decodeRows() {
+    std::vector<float> scratch;
+    embeddings.clear();
+    for (size_t i = 0; i < quantized.rows(); ++i) {
+        scratch.assign(embeddings.stride(), 0.0f);
+        quantized.decode(i, 1, scratch.data(), embeddings.stride());
+        embeddings.appendRow({ scratch.data(), embeddings.dim() });
+    }
+    quantized.clear();
+    recomputeNorms();
+}
+
+// Sets up the storage's encoding (learning int8 ranges from the float rows)
+// and moves every row into codes
+void VectorStore::quantizeRows() {
+    auto encoding = encodingOf(storage);
+    std::cerr << "[DEBUG] Encoding " << embeddings.rows() << " rows as "
+              << encodingName(encoding) << "\n";
+    quantized.train(embeddings, encoding);
+    for (size_t i = 0; i < embeddings.rows(); ++i) quantized.appendRow(embeddings.row(i));
+    embeddings.clear();
+    recomputeNorms();
+}
+
+std::span<const float> VectorStore::denseRow(size_t row, std::vector<float>& scratch) const {
+    if (!isQuantized()) return embeddings.row(row);
+    scratch.resize(quantized.dim());
+    quantized.decode(row, 1, scratch.data(), quantized.dim());
+    return { scratch.data(), quantized.dim() };
+}
+
+
 
 void VectorStore::addDocuments(const std::vector<std::string>& texts) {
     for (const auto& t : texts) addDocument(t);
 }
 
+// ------------------------------------------------------------------
+// Deletes, updates and compaction
+// ------------------------------------------------------------------
+bool VectorStore::removeDocument(size_t row) {
+    if (row >= documents.size() || metadata.isDeleted(row)) return false;
+    metadata.markDeleted(row);
+    unfitRow(row);
+    documentBytes -= textSize(documents[row]);
+    documents.set(row, nullptr);
+    return true;
+}
+
+template <typename Embedding>
+size_t VectorStore::moveDocument(size_t row, SharedText text, const Embedding& embedding) {
+    RowMetadata meta = metadata.get(row);
+    removeDocument(row);
+    addDocument(std::move(text), embedding);
+    size_t moved = documents.size() - 1;
+    metadata.set(moved, meta);
+    return moved;
+}
+
+size_t VectorStore::updateDocument(size_t row, const std::string& text,
+                                   const std::vector<float>& embedding) {
+    return updateDocument(row, std::make_shared<const std::string>(text), embedding);
+}
+
+size_t VectorStore::updateDocument(size_t row, const std::string& text,
+                                   const SparseVector& embedding) {
+    return updateDocument(row, std::make_shared<const std::string>(text), embedding);
+}
+
+size_t VectorStore::updateDocument(size_t row, SharedText text,
+                                   const std::vector<float>& embedding) {
+    // Graph links and CSR rows cannot change in place
+    bool inPlace = row < documents.size() && !metadata.isDeleted(row)
+                && layout == Layout::Dense && searchIndex != SearchIndex::Hnsw;
+    if (!inPlace) return moveDocument(row, std::move(text), embedding);
+
+    std::vector<float> scratch;
+    std::span<const float> stored;
+    if (isQuantized()) {
+        quantized.setRow(row, embedding);
+        stored = denseRow(row, scratch);
+    } else {
+        embeddings.setRow(row, embedding);
+        stored = embeddings.row(row);
+    }
+    squaredNorms.set(row, SimdKernels::dot(stored.data(), stored.data(), stored.size()));
+    unitRows = unitRows && std::fabs(squaredNorms[row] - 1.0f) <= UNIT_NORM_TOLERANCE;
+
+    unfitRow(row);
+    documentBytes += textSize(text);
+    documentBytes -= textSize(documents[row]);
+    documents.set(row, std::move(text));
+
+    if (searchIndex == SearchIndex::Binary) binary.setRow(row, stored);
+    if (searchIndex == SearchIndex::Ivf && row < ivf.size()) {
+        QueryVector q = rowQuery(row);
+        ivf.reassign(static_cast<uint32_t>(row), [&](const RowBlock& centroids, float* out) {
+            similarity->scoreBlock(q.dense, centroids, out);
+        });
+    }
+    return row;
+}
+
+size_t VectorStore::updateDocument(size_t row, SharedText text,
+                                   const SparseVector& embedding) {
+    if (layout == Layout::Dense) return updateDocument(row, std::move(text), embedding.toDense());
+    return moveDocument(row, std::move(text), embedding);
+}
+
+bool VectorStore::needsCompaction() const {
+    size_t dead = metadata.deletedRows();
+    return dead > 0 && dead * COMPACT_DEAD_SHARE >= documents.size();
+}
+
+void VectorStore::compact() {
+    size_t dead = metadata.deletedRows();
+    if (dead == 0) return;
+    if (dead == documents.size()) {
+        clear();
+        return;
+    }
+
+    std::vector<uint8_t> keep(documents.size());
+    std::vector<float> norms;
+    norms.reserve(documents.size() - dead);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        keep[i] = !metadata.isDeleted(i);
+        if (keep[i]) norms.push_back(squaredNorms[i]);
+    }
+
+    documents.keepRows(keep);
+    fitted.keepRows(keep);
+    embeddings.keepRows(keep);
+    quantized.keepRows(keep);
+    sparseEmbeddings.keepRows(keep);
+    metadata.keepRows(keep);
+    access.keepRows(keep);
+
+    // Postings and graph links name rows by number, so they are rebuilt
+    // from the kept vectors; IVF keeps its centroids and reassigns
+    invertedIndex.clear();
+    recomputeNorms(std::move(norms));
+    hnsw.clear();
+    ivf.clearLists();
+    binary.clearCodes();
+    syncAnnIndex();
+}
+
+void VectorStore::removeRows(const std::vector<uint32_t>& rows) {
+    for (uint32_t row : rows) removeDocument(row);
+    compact();
+}
+
 void VectorStore::clear() {
     documents.clear();
+    fitted.clear();
+    documentBytes = 0;
+    access.clear();
     embeddings.clear();
+    sparseEmbeddings.clear();
+    squaredNorms.clear();
+    unitRows = true;
+    metadata.clear();
+    invertedIndex.clear();
+    quantized.clearRows();
+    hnsw.clear();
+    ivf.clearLists();
+    binary.clearCodes();
 }
 
-std::vector<std::pair<std::string, float>> VectorStore::retrieve(const std::string& query, int topK) {
-    if (documents.empty() || embeddings.empty()) {
+// Posting lists only carry per-term products, so they serve metrics that
+// are (normalized) dot products; everything else takes the full scan.
+bool VectorStore::canUseInvertedIndex() const {
+    return layout == Layout::Sparse
+        && similarity->dotForm() != ISimilarity::DotForm::None
+        && invertedIndex.dim() == sparseEmbeddings.dim();
+}
+
+size_t VectorStore::scanBlockRows() const {
+    size_t rowBytes = std::max<size_t>(1, embeddings.stride() * sizeof(float));
+    return std::max(MIN_SCAN_BLOCK_ROWS, SCAN_BLOCK_BYTES / rowBytes);
+}
+
+RowBlock VectorStore::rowBlock(size_t begin, size_t count, std::vector<float>& scratch) const {
+    RowBlock block;
+    if (isQuantized()) {
+        scratch.resize(count * embeddings.stride());
+        quantized.decode(begin, count, scratch.data(), embeddings.stride());
+        block.data = scratch.data();
+    } else {
+        block.data = embeddings.row(begin).data();
+    }
+    block.stride = embeddings.stride();
+    block.dim = embeddings.dim();
+    block.count = count;
+    block.squaredNorms = squaredNorms.row(begin);
+    block.unitNorm = unitRows;
+    return block;
+}
+
+SparseRowBlock VectorStore::sparseRowBlock(size_t begin, size_t count) const {
+    SparseRowBlock block;
+    block.offsets = sparseEmbeddings.rowOffsets(begin);
+    block.indices = sparseEmbeddings.indexData(begin);
+    block.values = sparseEmbeddings.valueData(begin);
+    block.count = count;
+    block.squaredNorms = squaredNorms.row(begin);
+    block.unitNorm = unitRows;
+    return block;
+}
+
+std::vector<SearchHit> VectorStore::retrieve(const std::string& query, int topK,
+                                             const SearchFilter& filter) const {
+    auto results = retrieveBatch({ query }, topK, filter);
+    return results.empty() ? std::vector<SearchHit>{} : std::move(results.front());
+}
+
+std::vector<std::vector<SearchHit>> VectorStore::retrieveBatch(
+    const std::vector<std::string>& queries, int topK, const SearchFilter& filter) const {
+    std::vector<std::vector<SearchHit>> results(queries.size());
+    if (documents.empty()) {
         std::cerr << "[ERROR] retrieve() called but no documents/embeddings loaded.\n";
-        return {};
+        return results;
+    }
+
+    // Embed every query up front; one that fails keeps an empty result
+    std::vector<QueryVector> embedded;
+    std::vector<size_t> slots;
+    embedded.reserve(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        QueryVector queryVec;
+        if (!embedQuery(queries[i], queryVec)) {
+            std::cerr << "[ERROR] Query embedding failed! Query=\"" << queries[i] << "\"\n";
+            continue;
+        }
+        embedded.push_back(std::move(queryVec));
+        slots.push_back(i);
+    }
+    if (embedded.empty()) return results;
+
+    // The filter is resolved against the metadata dictionaries once, up front
+    RowFilter rowFilter;
+    const RowFilter* rows = compileFilter(filter, rowFilter);
+    if (rows && rows->matches() == 0) {
+        std::cerr << "[WARN] No rows match the search filter.\n";
+        return results;
+    }
+
+    size_t k = static_cast<size_t>(std::max(topK, 0));
+    bool mmr = mmrLambda < 1.0f && k > 1;
+    size_t candidates = mmr ? k * MMR_POOL_FACTOR : k;
+
+    // A narrow filter leaves few rows: scanning them beats walking the index
+    bool useAnn = annReady()
+        && (!rows || rows->matches() * FILTERED_ANN_MIN_SHARE >= squaredNorms.size());
+
+    // Index lookups run per query; the full scan shares each row block
+    std::vector<std::vector<SearchHit>> hits;
+    if (useAnn || canUseInvertedIndex()) {
+        hits.reserve(embedded.size());
+        for (const auto& queryVec : embedded) {
+            hits.push_back(useAnn ? annSearch(queryVec, candidates, scoreThreshold, rows)
+                                  : exactSearch(queryVec, candidates, scoreThreshold, rows));
+        }
+    } else {
+        hits = scanSearch(embedded, candidates, scoreThreshold, rows);
+    }
+
+    size_t found = 0;
+    uint64_t now = RowAccessLog::tick();
+    for (size_t j = 0; j < embedded.size(); ++j) {
+        if (mmr) hits[j] = diversify(hits[j], k);
+        if (hits[j].empty()) {
+            std::cerr << "[WARN] No relevant results found for query=\"" << queries[slots[j]] << "\"\n";
+        }
+        for (const auto& hit : hits[j]) access.record(hit.doc, now);
+        found += hits[j].size();
+        results[slots[j]] = std::move(hits[j]);
     }
 
-    auto queryVec = embeddingEngine->embed(query);
-    if (queryVec.empty()) {
-        std::cerr << "[ERROR] Query embedding failed! Query=\"" << query << "\"\n";
-        return {};
+    if (found > 0) {
+        std::cerr << "[DEBUG] Retrieved " << found << " results";
+        if (queries.size() > 1) std::cerr << " for " << queries.size() << " queries";
+        const char* via = !useAnn ? ""
+                         : searchIndex == SearchIndex::Ivf    ? " (ivf)"
+                         : searchIndex == SearchIndex::Binary ? " (binary)"
+                                                              : " (hnsw)";
+        std::cerr << via << ".\n";
     }
-    std::cerr << "[DEBUG] Query embedding size=" << queryVec.size() 
+    return results;
+}
+
+std::vector<SearchHit> VectorStore::diversify(const std::vector<SearchHit>& pool,
+                                              size_t topK) const {
+    size_t n = pool.size();
+    size_t want = std::min(topK, n);
+    std::vector<SearchHit> picked;
+    picked.reserve(want);
+    if (want == 0) return picked;
+
+    // Dense candidates are gathered once, so each pick is one scoreBlock()
+    // call against the whole pool; no text is re-embedded
+    std::vector<float> gathered;
+    std::vector<float> norms;
+    RowBlock block;
+    if (layout == Layout::Dense) {
+        std::vector<float> scratch;
+        size_t stride = embeddings.stride();
+        gathered.assign(n * stride, 0.0f);
+        norms.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            auto r = denseRow(pool[i].doc, scratch);
+            std::copy(r.begin(), r.end(), gathered.begin() + i * stride);
+            norms.push_back(squaredNorms[pool[i].doc]);
+        }
+        block.data = gathered.data();
+        block.stride = stride;
+        block.dim = rowDimension();
+        block.count = n;
+        block.squaredNorms = norms.data();
+        block.unitNorm = unitRows;
+    }
+
+    std::vector<float> closest(n, -std::numeric_limits<float>::infinity());
+    std::vector<float> sims(n);
+    std::vector<uint8_t> taken(n, 0);
+    size_t next = 0;   // the best-scoring candidate always leads
+    while (true) {
+        taken[next] = 1;
+        picked.push_back(pool[next]);
+        if (picked.size() == want) break;
+
+        if (layout == Layout::Dense) {
+            similarity->scoreBlock(block.row(next), block, sims.data());
+        } else {
+            QueryVector pick = rowQuery(pool[next].doc);
+            for (size_t i = 0; i < n; ++i) {
+                if (!taken[i]) sims[i] = scoreRow(pick, pool[i].doc);
+            }
+        }
+
+        float best = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < n; ++i) {
+            if (taken[i]) continue;
+            closest[i] = std::max(closest[i], sims[i]);
+            float gain = mmrLambda * pool[i].score - (1.0f - mmrLambda) * closest[i];
+            if (gain > best) {
+                best = gain;
+                next = i;
+            }
+        }
+    }
+    return picked;
+}
+
+const VectorStore::RowFilter* VectorStore::compileFilter(const SearchFilter& filter,
+                                                        RowFilter& storage) const {
+    if (filter.empty() && metadata.deletedRows() == 0) return nullptr;
+    storage = metadata.compile(filter);
+    return &storage;
+}
+
+bool VectorStore::embedQuery(const std::string& text, QueryVector& query) const {
+    if (layout == Layout::Sparse) {
+        query.sparse = embeddingEngine->embedSparse(text);
+        if (query.sparse.empty()) return false;
+        std::cerr << "[DEBUG] Query embedding nnz=" << query.sparse.nnz()
+                  << ", docs=" << documents.size() << "\n";
+
+        // Scatter once so every row is a gather over its own non-zeros
+        query.dense.assign(sparseEmbeddings.dim(), 0.0f);
+        for (size_t k = 0; k < query.sparse.nnz(); ++k) {
+            if (query.sparse.indices[k] < query.dense.size()) {
+                query.dense[query.sparse.indices[k]] = query.sparse.values[k];
+            }
+        }
+        return true;
+    }
+
+    query.dense = embeddingEngine->embed(text);
+    if (query.dense.empty()) return false;
+    std::cerr << "[DEBUG] Query embedding size=" << query.dense.size()
               << ", docs=" << documents.size() << "\n";
+    return true;
+}
+
+// A stored row posed as a query (graph construction and recall sampling)
+VectorStore::QueryVector VectorStore::rowQuery(size_t row) const {
+    QueryVector query;
+    if (layout == Layout::Sparse) {
+        SparseRowView r = sparseEmbeddings.row(row);
+        query.sparse.indices.assign(r.indices.begin(), r.indices.end());
+        query.sparse.values.assign(r.values.begin(), r.values.end());
+        query.sparse.dimension = sparseEmbeddings.dim();
+        query.dense.assign(sparseEmbeddings.dim(), 0.0f);
+        SparseKernels::scatter(r, query.dense);
+    } else {
+        std::vector<float> scratch;
+        auto r = denseRow(row, scratch);
+        query.dense.assign(r.begin(), r.end());
+    }
+    return query;
+}
+
+float VectorStore::scoreRow(const QueryVector& query, size_t row) const {
+    float score = 0.0f;
+    if (layout == Layout::Sparse) {
+        similarity->scoreSparseBlock(query.sparse.view(), query.dense, sparseRowBlock(row, 1), &score);
+    } else {
+        thread_local std::vector<float> scratch;
+        similarity->scoreBlock(query.dense, rowBlock(row, 1, scratch), &score);
+    }
+    return score;
+}
+
+float VectorStore::pairScore(uint32_t a, uint32_t b) const {
+    if (layout == Layout::Sparse) {
+        return (*similarity)(sparseEmbeddings.row(a), sparseEmbeddings.row(b));
+    }
+    thread_local std::vector<float> scratchA, scratchB;
+    return (*similarity)(denseRow(a, scratchA), denseRow(b, scratchB));
+}
+
+std::vector<SearchHit> VectorStore::exactSearch(const QueryVector& query, size_t topK,
+                                                float minScore, const RowFilter* filter) const {
+    if (layout == Layout::Sparse && canUseInvertedIndex()) {
+        // Only rows sharing a term with the query can score above zero.
+        // Cosine between unit vectors is their dot product.
+        bool cosine = similarity->dotForm() == ISimilarity::DotForm::CosineDot
+            && !(unitRows && std::fabs(query.sparse.squaredNorm() - 1.0f) <= UNIT_NORM_TOLERANCE);
+        auto scoring = cosine ? InvertedIndex::Scoring::Cosine : InvertedIndex::Scoring::Dot;
+        InvertedIndex::Accept accept;
+        if (filter) accept = [filter](uint32_t row) { return filter->allows(row); };
+        return invertedIndex.search(query.sparse.view(), scoring, topK, minScore,
+                                    &squaredNorms, accept);
+    }
+    return std::move(scanSearch({ &query, 1 }, topK, minScore, filter).front());
+}
+
+std::vector<std::vector<SearchHit>> VectorStore::scanSearch(std::span<const QueryVector> queries,
+                                                            size_t topK, float minScore,
+                                                            const RowFilter* filter) const {
+    const size_t rows = squaredNorms.size();
+    const size_t blockRows = layout == Layout::Sparse ? SPARSE_SCAN_BLOCK_ROWS : scanBlockRows();
+    const size_t blocks = (rows + blockRows - 1) / blockRows;
+    size_t parts = pool && rows >= PARALLEL_MIN_ROWS ? std::min(pool->size(), blocks) : 1;
+
+    std::vector<TopK> heaps(queries.size(), TopK(topK));
+    if (parts <= 1) {
+        scanRows(queries, 0, rows, minScore, filter, heaps);
+    } else {
+        // Contiguous block-aligned ranges, one set of heaps each, merged on
+        // the caller. TopK breaks ties by row, so the result matches the
+        // serial scan.
+        std::vector<std::vector<std::vector<SearchHit>>> partial(parts);
+        pool->parallelFor(parts, [&](size_t p) {
+            size_t begin = blocks * p / parts * blockRows;
+            size_t end = std::min(rows, blocks * (p + 1) / parts * blockRows);
+            std::vector<TopK> local(queries.size(), TopK(topK));
+            scanRows(queries, begin, end, minScore, filter, local);
+            for (auto& heap : local) partial[p].push_back(heap.take());
+        });
+
+        for (const auto& part : partial) {
+            for (size_t q = 0; q < queries.size(); ++q) {
+                for (const auto& h : part[q]) heaps[q].offer(h.doc, h.score);
+            }
+        }
+    }
 
-    // Min-heap: smallest score at the top
-    auto cmp = [](const std::pair<std::string, float>& a, const std::pair<std::string, float>& b) {
-        return a.second > b.second;
+    std::vector<std::vector<SearchHit>> results;
+    results.reserve(queries.size());
+    for (auto& heap : heaps) results.push_back(heap.take());
+    return results;
+}
+
+void VectorStore::scanRows(std::span<const QueryVector> queries, size_t begin, size_t end,
+                           float minScore, const RowFilter* filter,
+                           std::vector<TopK>& heaps) const {
+    auto offer = [&](TopK& heap, size_t first, size_t count, const float* scores) {
+        for (size_t j = 0; j < count; ++j) {
+            if (scores[j] >= minScore) heap.offer(static_cast<uint32_t>(first + j), scores[j]);
+        }
+    };
+    // Score a row must reach to matter: the threshold, or once the heap is
+    // full its worst entry (rows arrive in ascending order, so a tie loses)
+    auto bound = [&](const TopK& heap) {
+        return heap.full() && heap.size() > 0 ? std::max(minScore, heap.worstScore()) : minScore;
+    };
+    // Hands each run of consecutive accepted rows in [first, first + count)
+    // to score, so filtered-out rows are skipped before scoring
+    auto forEachRun = [&](size_t first, size_t count, const auto& score) {
+        if (!filter) {
+            score(first, count);
+            return;
+        }
+        size_t last = first + count;
+        for (size_t a = first; a < last;) {
+            while (a < last && !filter->allows(a)) ++a;
+            size_t b = a;
+            while (b < last && filter->allows(b)) ++b;
+            if (b > a) score(a, b - a);
+            a = b;
+        }
     };
-    std::priority_queue<
-        std::pair<std::string, float>,
-        std::vector<std::pair<std::string, float>>,
-        decltype(cmp)
-    > minHeap(cmp);
 
-    for (size_t i = 0; i < documents.size(); ++i) {
-        float score = (*similarity)(queryVec, embeddings[i]);
-        std::cerr << "[DEBUG] Doc " << i << " score=" << score << "\n";
+    // Score the rows block by block; one virtual call per block and query.
+    // Every query scores a block while it is still in cache.
+    if (layout == Layout::Sparse) {
+        // Rows gather from each query's scattered buffer, so queries go in
+        // groups whose buffers fit in cache together
+        size_t queryBytes = std::max<size_t>(1, sparseEmbeddings.dim() * sizeof(float));
+        size_t group = std::max<size_t>(1, SCAN_BLOCK_BYTES / queryBytes);
+        std::vector<float> scores(SPARSE_SCAN_BLOCK_ROWS);
+        for (size_t q0 = 0; q0 < queries.size(); q0 += group) {
+            size_t q1 = std::min(queries.size(), q0 + group);
+            for (size_t first = begin, count; first < end; first += count) {
+                count = runRows(first, std::min(SPARSE_SCAN_BLOCK_ROWS, end - first));
+                forEachRun(first, count, [&](size_t a, size_t n) {
+                    SparseRowBlock block = sparseRowBlock(a, n);
+                    for (size_t q = q0; q < q1; ++q) {
+                        similarity->scoreSparseBlockAbove(queries[q].sparse.view(), queries[q].dense,
+                                                          block, bound(heaps[q]), scores.data());
+                        offer(heaps[q], a, n, scores.data());
+                    }
+                });
+            }
+        }
+    } else {
+        // Int8 rows are decoded one block at a time into scratch, once per batch
+        const size_t blockRows = scanBlockRows();
+        std::vector<float> scores(blockRows);
+        std::vector<float> scratch;
+        for (size_t first = begin, count; first < end; first += count) {
+            count = runRows(first, std::min(blockRows, end - first));
+            forEachRun(first, count, [&](size_t a, size_t n) {
+                RowBlock block = rowBlock(a, n, scratch);
+                for (size_t q = 0; q < queries.size(); ++q) {
+                    similarity->scoreBlockAbove(queries[q].dense, block, bound(heaps[q]),
+                                                scores.data());
+                    offer(heaps[q], a, n, scores.data());
+                }
+            });
+        }
+    }
+}
 
-        if (score < SIMILARITY_THRESHOLD) continue;
+void VectorStore::setSearchThreads(size_t threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    if (threads == searchThreads) return;
+    searchThreads = threads;
+    pool = threads > 1 ? std::make_shared<ThreadPool>(threads) : nullptr;
+}
 
-        if ((int)minHeap.size() < topK) {
-            minHeap.emplace(documents[i], score);
-        } else if (score > minHeap.top().second) {
-            minHeap.pop();
-            minHeap.emplace(documents[i], score);
+bool VectorStore::annReady() const {
+    size_t rows = squaredNorms.size();
+    switch (searchIndex) {
+    case SearchIndex::Hnsw: return hnsw.size() == rows;
+    case SearchIndex::Ivf:  return ivf.trained() && ivf.size() == rows;
+    case SearchIndex::Binary: return binary.trained() && binary.size() == rows;
+    default:                return false;
+    }
+}
+
+std::vector<SearchHit> VectorStore::annSearch(const QueryVector& query, size_t topK,
+                                              float minScore, const RowFilter* filter) const {
+    if (searchIndex == SearchIndex::Ivf) return ivfSearch(query, topK, minScore, filter);
+    if (searchIndex == SearchIndex::Binary) return binarySearch(query, topK, minScore, filter);
+
+    HnswIndex::Accept accept;
+    if (filter) accept = [filter](uint32_t row) { return filter->allows(row); };
+    auto hits = hnsw.search([&](uint32_t row) { return scoreRow(query, row); }, topK, accept);
+    hits.erase(std::remove_if(hits.begin(), hits.end(),
+                              [&](const SearchHit& h) { return h.score < minScore; }),
+               hits.end());
+    return hits;
+}
+
+// ------------------------------------------------------------------
+// HNSW index
+// ------------------------------------------------------------------
+void VectorStore::setSearchIndex(SearchIndex index) {
+    searchIndex = index;
+    if (index != SearchIndex::Hnsw) hnsw.clear();
+    if (index != SearchIndex::Ivf) ivf.clearLists();
+    if (index != SearchIndex::Binary) binary.clearCodes();
+    syncAnnIndex();
+}
+
+void VectorStore::setHnswParams(const HnswIndex::Params& params) {
+    const auto& current = hnsw.params();
+    bool relink = params.M != current.M || params.efConstruction != current.efConstruction;
+    if (relink) hnsw.clear();
+    hnsw.setParams(params);
+    if (relink && searchIndex == SearchIndex::Hnsw) syncAnnIndex();
+}
+
+// Brings the active ANN index up to date with the rows
+void VectorStore::syncAnnIndex() {
+    if (searchIndex == SearchIndex::Ivf) {
+        syncIvf();
+        return;
+    }
+    if (searchIndex == SearchIndex::Binary) {
+        syncBinary();
+        return;
+    }
+    if (searchIndex != SearchIndex::Hnsw) return;
+
+    // Link any rows the graph has not seen yet
+    if (hnsw.size() > squaredNorms.size()) hnsw.clear();
+    if (hnsw.size() == squaredNorms.size()) return;
+
+    if (squaredNorms.size() - hnsw.size() > 1) {
+        std::cerr << "[DEBUG] Linking " << squaredNorms.size() - hnsw.size()
+                  << " rows into the HNSW graph\n";
+    }
+    auto pair = [this](uint32_t a, uint32_t b) { return pairScore(a, b); };
+    while (hnsw.size() < squaredNorms.size()) hnsw.insert(pair);
+}
+
+double VectorStore::measureRecall(size_t sampleQueries, int topK) const {
+    size_t rows = squaredNorms.size();
+    if (rows == 0 || sampleQueries == 0 || topK <= 0) return 0.0;
+
+    bool useAnn = annReady();
+    size_t step = std::max<size_t>(1, rows / sampleQueries);
+    size_t k = static_cast<size_t>(topK);
+    const float noThreshold = -std::numeric_limits<float>::infinity();
+
+    RowFilter live;
+    const RowFilter* filter = compileFilter(SearchFilter(), live);
+
+    size_t found = 0, expected = 0;
+    for (size_t row = 0; row < rows && row / step < sampleQueries; row += step) {
+        if (metadata.isDeleted(row)) continue;
+        QueryVector query = rowQuery(row);
+        auto truth = exactSearch(query, k, noThreshold, filter);
+        auto approx = useAnn ? annSearch(query, k, noThreshold, filter) : truth;
+
+        std::vector<uint32_t> approxDocs;
+        for (const auto& h : approx) approxDocs.push_back(h.doc);
+        std::sort(approxDocs.begin(), approxDocs.end());
+        for (const auto& h : truth) {
+            found += std::binary_search(approxDocs.begin(), approxDocs.end(), h.doc);
         }
+        expected += truth.size();
     }
+    return expected ? static_cast<double>(found) / expected : 1.0;
+}
 
-    std::vector<std::pair<std::string, float>> results;
-    while (!minHeap.empty()) {
-        results.push_back(minHeap.top());
-        minHeap.pop();
+uint64_t VectorStore::rowFingerprint() const {
+    uint64_t h = documents.size();
+    for (const auto& doc : documents) {
+        std::string_view text = doc ? std::string_view(*doc) : std::string_view();
+        h = (h ^ std::hash<std::string_view>{}(text)) * 0x100000001b3ull;
     }
-    std::reverse(results.begin(), results.end());
+    return h;
+}
 
-    if (results.empty()) {
-        std::cerr << "[WARN] No relevant results found for query=\"" << query << "\"\n";
+bool VectorStore::saveAnnIndex(const std::string& path) const {
+    try {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) return false;
+        uint64_t header[2] = { documents.size(), rowFingerprint() };
+        out.write(reinterpret_cast<const char*>(&ANN_FILE_MAGIC), sizeof(ANN_FILE_MAGIC));
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        if (searchIndex == SearchIndex::Ivf) return ivf.write(out);
+        if (searchIndex == SearchIndex::Binary) return binary.write(out);
+        return hnsw.write(out);
+    } catch (...) {
+        return false;
+    }
+}
+
+bool VectorStore::loadAnnIndex(const std::string& path) {
+    try {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+
+        // Rows saved in another order or set would be matched to the wrong
+        // vectors; files without the header predate the check
+        uint32_t magic = 0;
+        uint64_t header[2] = {};
+        in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!in || magic != ANN_FILE_MAGIC) {
+            std::cerr << "[WARN] " << path << " has no row fingerprint; rebuilding the ANN index.\n";
+            return false;
+        }
+        bool sameRows = header[0] == documents.size() && header[1] == rowFingerprint();
+
+        // The index's own magic says which one it holds
+        std::streampos start = in.tellg();
+        in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        in.seekg(start);
+        if (!in) return false;
+
+        if (magic == IvfIndex::FILE_MAGIC) {
+            IvfIndex loaded;
+            if (!loaded.read(in) || loaded.params().nlist != ivf.params().nlist) {
+                std::cerr << "[WARN] Could not use IVF lists from " << path << "\n";
+                return false;
+            }
+            if (loaded.trained() && loaded.dim() != rowDimension()) {
+                std::cerr << "[WARN] IVF centroids in " << path << " have dimension "
+                          << loaded.dim() << ", store has " << rowDimension() << "; ignoring them.\n";
+                return false;
+            }
+            // Saved lists only describe the rows they were built over
+            if (!sameRows || loaded.size() != squaredNorms.size()) loaded.clearLists();
+            loaded.setParams(ivf.params());  // keep the configured nprobe
+            ivf = std::move(loaded);
+            return true;
+        }
+
+        if (magic == BinaryIndex::FILE_MAGIC) {
+            BinaryIndex loaded;
+            if (!loaded.read(in)) {
+                std::cerr << "[WARN] Could not read sign codes from " << path << "\n";
+                return false;
+            }
+            if (loaded.dim() != rowDimension()) {
+                std::cerr << "[WARN] Sign codes in " << path << " have dimension "
+                          << loaded.dim() << ", store has " << rowDimension() << "; ignoring them.\n";
+                return false;
+            }
+            if (!sameRows || loaded.size() != squaredNorms.size()) loaded.clearCodes();
+            loaded.setParams(binary.params());  // keep the configured candidates
+            binary = std::move(loaded);
+            syncBinary();
+            return true;
+        }
+
+        HnswIndex loaded;
+        if (!loaded.read(in)) {
+            std::cerr << "[WARN] Could not read HNSW graph from " << path << "\n";
+            return false;
+        }
+        if (loaded.params().M != hnsw.params().M
+            || loaded.params().efConstruction != hnsw.params().efConstruction) {
+            std::cerr << "[WARN] HNSW graph in " << path << " was built with other parameters; ignoring it.\n";
+            return false;
+        }
+        if (!sameRows || loaded.size() != squaredNorms.size()) {
+            std::cerr << "[WARN] HNSW graph in " << path << " was built over other rows; ignoring it.\n";
+            return false;
+        }
+        loaded.setParams(hnsw.params());  // keep the configured efSearch
+        hnsw = std::move(loaded);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+// ------------------------------------------------------------------
+// IVF index
+// ------------------------------------------------------------------
+void VectorStore::setIvfParams(const IvfIndex::Params& params) {
+    ivf.setParams(params);
+}
+
+size_t VectorStore::rowDimension() const {
+    return layout == Layout::Sparse ? sparseEmbeddings.dim() : embeddings.dim();
+}
+
+void VectorStore::accumulateRow(uint32_t row, std::span<float> sum) const {
+    if (layout == Layout::Sparse) {
+        SparseRowView r = sparseEmbeddings.row(row);
+        for (size_t k = 0; k < r.nnz(); ++k) sum[r.indices[k]] += r.values[k];
     } else {
-        std::cerr << "[DEBUG] Retrieved " << results.size() << " results.\n";
+        std::vector<float> scratch;
+        auto r = denseRow(row, scratch);
+        for (size_t d = 0; d < r.size(); ++d) sum[d] += r[d];
     }
+}
 
-    return results;
+// The centroid plays the query so rows are scored with the blocked kernels
+void VectorStore::scoreRowsAgainst(std::span<const float> centroid, size_t begin, size_t count,
+                                   float* out) const {
+    if (layout == Layout::Sparse) {
+        SparseVector sparse = SparseVector::fromDense(centroid);
+        for (size_t done = 0, n; done < count; done += n) {
+            n = runRows(begin + done, count - done);
+            similarity->scoreSparseBlock(sparse.view(), centroid, sparseRowBlock(begin + done, n),
+                                         out + done);
+        }
+    } else {
+        const size_t blockRows = scanBlockRows();
+        std::vector<float> scratch;
+        for (size_t done = 0, n; done < count; done += n) {
+            n = runRows(begin + done, std::min(blockRows, count - done));
+            similarity->scoreBlock(centroid, rowBlock(begin + done, n, scratch), out + done);
+        }
+    }
+}
+
+bool VectorStore::trainIvf() {
+    size_t rows = squaredNorms.size();
+    if (rows == 0) return false;
+
+    std::cerr << "[DEBUG] Training IVF centroids over " << rows << " rows\n";
+    ivf.train(rows, rowDimension(),
+              [this](uint32_t row, std::span<float> sum) { accumulateRow(row, sum); },
+              [this](std::span<const float> c, size_t begin, size_t count, float* out) {
+                  scoreRowsAgainst(c, begin, count, out);
+              });
+    return ivf.trained();
 }
 
+void VectorStore::prepareSearch() {
+    if (searchIndex == SearchIndex::Ivf && !ivf.trained()) trainIvf();
+    if (searchIndex == SearchIndex::Binary && !binary.trained()) {
+        size_t rows = squaredNorms.size();
+        if (rows == 0) return;
+        std::cerr << "[DEBUG] Learning sign-code thresholds over " << rows << " rows\n";
+        binary.train(rows, rowDimension(),
+                     [this](uint32_t row, std::span<float> sum) { accumulateRow(row, sum); });
+        syncBinary();
+    }
+}
 
+// Assigns rows added since the lists were last in step; never retrains
+void VectorStore::syncIvf() {
+    if (!ivf.trained()) return;
+    if (ivf.dim() != rowDimension()) {
+        ivf.clear();
+        return;
+    }
+    if (ivf.size() > squaredNorms.size()) ivf.clearLists();
+
+    while (ivf.size() < squaredNorms.size()) {
+        QueryVector row = rowQuery(ivf.size());
+        ivf.add([&](const RowBlock& centroids, float* out) {
+            similarity->scoreBlock(row.dense, centroids, out);
+        });
+    }
+}
+
+// ------------------------------------------------------------------
+// Binary sign codes
+// ------------------------------------------------------------------
+std::span<const float> VectorStore::rowVector(size_t row, std::vector<float>& scratch) const {
+    if (layout == Layout::Dense) return denseRow(row, scratch);
+    scratch.assign(sparseEmbeddings.dim(), 0.0f);
+    SparseKernels::scatter(sparseEmbeddings.row(row), scratch);
+    return scratch;
+}
+
+// Encodes rows added since the codes were last in step; never retrains
+void VectorStore::syncBinary() {
+    if (!binary.trained()) return;
+    if (binary.dim() != rowDimension()) {
+        binary.clear();
+        return;
+    }
+    if (binary.size() > squaredNorms.size()) binary.clearCodes();
+
+    std::vector<float> scratch;
+    while (binary.size() < squaredNorms.size()) binary.add(rowVector(binary.size(), scratch));
+}
+
+// Hamming distance picks the candidates; the store's metric orders them
+std::vector<SearchHit> VectorStore::binarySearch(const QueryVector& query, size_t topK,
+                                                 float minScore, const RowFilter* filter) const {
+    BinaryIndex::Accept accept;
+    if (filter) accept = [filter](uint32_t row) { return filter->allows(row); };
+    auto rows = binary.nearest(query.dense, std::max(topK, binary.params().candidates), accept);
+
+    TopK heap(topK);
+    for (uint32_t row : rows) {
+        float score = scoreRow(query, row);
+        if (score >= minScore) heap.offer(row, score);
+    }
+    return heap.take();
+}
+
+std::vector<SearchHit> VectorStore::ivfSearch(const QueryVector& query, size_t topK,
+                                              float minScore, const RowFilter* filter) const {
+    auto lists = ivf.probe([&](const RowBlock& centroids, float* out) {
+        similarity->scoreBlock(query.dense, centroids, out);
+    });
+
+    TopK heap(topK);
+    for (uint32_t list : lists) {
+        for (uint32_t row : ivf.list(list)) {
+            if (filter && !filter->allows(row)) continue;
+            float score = scoreRow(query, row);
+            if (score >= minScore) heap.offer(row, score);
+        }
+    }
+    return heap.take();
+}
+
+
+// File layout: numDocs, then each text (length + bytes), then the layout
+// byte and the dense, encoded (int8/fp16/bf16) or CSR matrix written in bulk (see
+// EmbeddingMatrix::write, QuantizedMatrix::write and SparseMatrix::write),
+// then the row norms and the metadata columns. Older files stop after the
+// matrix or the norms.
 bool VectorStore::loadEmbeddings(const std::string& filepath) {
     try {
         std::ifstream in(filepath, std::ios::binary);
         if (!in) return false;
 
         // Clear existing data
-        documents.clear();
-        embeddings.clear();
+        clear();
 
-        // Read metadata
         size_t numDocs = 0;
         in.read(reinterpret_cast<char*>(&numDocs), sizeof(numDocs));
 
-        // Read embedding method
-        int methodInt = 0;
-        in.read(reinterpret_cast<char*>(&methodInt), sizeof(methodInt));
-       // embeddingMethod = static_cast<EmbeddingMethod>(methodInt);
-
-        // Read documents and embeddings
         for (size_t i = 0; i < numDocs; ++i) {
-            // Read document text
             size_t textLen = 0;
             in.read(reinterpret_cast<char*>(&textLen), sizeof(textLen));
             std::string text(textLen, '\0');
             in.read(&text[0], textLen);
-            documents.push_back(text);
+            documentBytes += text.size();
+            documents.push_back(std::make_shared<const std::string>(std::move(text)));
+            fitted.push_back(0);
+            access.append();
+        }
 
-            // Read embedding vector
-            size_t embeddingSize = 0;
-            in.read(reinterpret_cast<char*>(&embeddingSize), sizeof(embeddingSize));
-            std::vector<float> emb(embeddingSize);
-            in.read(reinterpret_cast<char*>(emb.data()), embeddingSize * sizeof(float));
-            embeddings.push_back(std::move(emb));
+        uint8_t tag = 0;
+        in.read(reinterpret_cast<char*>(&tag), sizeof(tag));
+        bool ok = false;
+        if (tag == QUANTIZED_FILE_TAG || tag == FP16_FILE_TAG || tag == BF16_FILE_TAG) {
+            layout = Layout::Dense;
+            storage = tag == FP16_FILE_TAG ? Storage::Float16
+                    : tag == BF16_FILE_TAG ? Storage::BFloat16
+                                           : Storage::Int8;
+            ok = quantized.read(in, encodingOf(storage)) && embeddings.setDimension(quantized.dim());
+        } else {
+            layout = static_cast<Layout>(tag);
+            quantized.clear();
+            ok = (layout == Layout::Sparse) ? sparseEmbeddings.read(in) : embeddings.read(in);
+            if (ok && layout == Layout::Dense && storage != Storage::Float32
+                && embeddings.rows() >= encodeMinRows()) {
+                quantizeRows();
+            }
+        }
+        if (!ok) {
+            std::cerr << "[ERROR] Failed to read embedding matrix from " << filepath << "\n";
+            clear();
+            return false;
+        }
+
+        // Row norms follow the rows; files written without them recompute.
+        // A block of the wrong length is skipped so the metadata still lines up.
+        std::vector<float> savedNorms;
+        uint64_t normCount = 0;
+        if (in.read(reinterpret_cast<char*>(&normCount), sizeof(normCount))) {
+            if (normCount == documents.size()) {
+                savedNorms.resize(normCount);
+                in.read(reinterpret_cast<char*>(savedNorms.data()), normCount * sizeof(float));
+                if (!in) savedNorms.clear();
+            } else {
+                std::cerr << "[WARN] " << normCount << " saved row norms for " << documents.size()
+                          << " rows in " << filepath << "; recomputing them.\n";
+                if (normCount > UINT32_MAX) in.setstate(std::ios::failbit);
+                else in.seekg(static_cast<std::streamoff>(normCount * sizeof(float)), std::ios::cur);
+            }
+        }
+        recomputeNorms(std::move(savedNorms));
+        if (!metadata.read(in) || metadata.rows() != documents.size()) {
+            metadata.clear();
+            for (size_t i = 0; i < documents.size(); ++i) metadata.append({});
+        }
+        syncAnnIndex();
+
+        if (documents.size() != squaredNorms.size()) {
+            std::cerr << "[ERROR] Mismatch: documents=" << documents.size()
+                      << ", embeddings=" << squaredNorms.size() << "\n";
+            clear();
+            return false;
         }
 
         return true;
     } catch (...) {
         return false;
     }
-if (documents.size() != embeddings.size()) {
-    std::cerr << "[ERROR] Mismatch: documents=" << documents.size() 
-              << ", embeddings=" << embeddings.size() << "\n";
-}
-
 }
 
 
 bool VectorStore::saveEmbeddings(const std::string& filepath) const {
-        try {
-            std::ofstream out(filepath, std::ios::binary);
-            if (!out) return false;
-            
-            // Write metadata
-            size_t numDocs = documents.size();
-            out.write(reinterpret_cast<const char*>(&numDocs), sizeof(numDocs));
-            
-            // Write embedding method
-            //out.write(reinterpret_cast<const char*>(&embeddingMethod), sizeof(embeddingMethod));
-            
-            // Write documents and embeddings
-            for (size_t i = 0; i < numDocs; ++i) {
-                size_t textLen = documents[i].length();
-                out.write(reinterpret_cast<const char*>(&textLen), sizeof(textLen));
-                out.write(documents[i].data(), textLen);
-                
-                size_t embeddingSize = embeddings[i].size();
-                out.write(reinterpret_cast<const char*>(&embeddingSize), sizeof(embeddingSize));
-                out.write(reinterpret_cast<const char*>(embeddings[i].data()), 
-                         embeddingSize * sizeof(float));
-            }
-            if (documents.size() != embeddings.size()) {
-    std::cerr << "[ERROR] Mismatch: documents=" << documents.size() 
-              << ", embeddings=" << embeddings.size() << "\n";
-}
+    // Tombstones are not saved: write a compacted copy (without ANN links)
+    if (metadata.deletedRows() > 0) {
+        VectorStore live(*this);
+        live.setSearchIndex(SearchIndex::Flat);
+        live.compact();
+        return live.saveEmbeddings(filepath);
+    }
+    try {
+        std::ofstream out(filepath, std::ios::binary);
+        if (!out) return false;
 
-            return true;
-        } catch (...) {
+        if (documents.size() != squaredNorms.size()) {
+            std::cerr << "[ERROR] Mismatch: documents=" << documents.size()
+                      << ", embeddings=" << squaredNorms.size() << "\n";
             return false;
         }
-    }
-    
-    // Memory usage estimation
-    size_t VectorStore::getMemoryUsage() const {
-        size_t total = 0;
+
+        size_t numDocs = documents.size();
+        out.write(reinterpret_cast<const char*>(&numDocs), sizeof(numDocs));
+
         for (const auto& doc : documents) {
-            total += doc.size();
+            size_t textLen = textSize(doc);
+            out.write(reinterpret_cast<const char*>(&textLen), sizeof(textLen));
+            if (doc) out.write(doc->data(), textLen);
         }
-        for (const auto& emb : embeddings) {
-            total += emb.size() * sizeof(float);
+
+        bool ok;
+        if (isQuantized()) {
+            uint8_t tag = storage == Storage::Float16  ? FP16_FILE_TAG
+                        : storage == Storage::BFloat16 ? BF16_FILE_TAG
+                                                       : QUANTIZED_FILE_TAG;
+            out.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
+            ok = quantized.write(out);
+        } else {
+            out.write(reinterpret_cast<const char*>(&layout), sizeof(layout));
+            ok = (layout == Layout::Sparse) ? sparseEmbeddings.write(out) : embeddings.write(out);
         }
-        return total;
+
+        uint64_t normCount = squaredNorms.size();
+        out.write(reinterpret_cast<const char*>(&normCount), sizeof(normCount));
+        return squaredNorms.writeRows(out) && ok && metadata.write(out);
+    } catch (...) {
+        return false;
     }
-    
-    // Remove old documents when memory gets too large
-    void VectorStore::enforceMemoryLimit(size_t maxMemoryBytes) {
-        while (getMemoryUsage() > maxMemoryBytes && !documents.empty()) {
-            documents.pop_back();
-            embeddings.pop_back();
-        }
+}
+
+// ------------------------------------------------------------------
+// Memory accounting and eviction
+// ------------------------------------------------------------------
+// Bytes every row costs whatever its text: vector payload, norm, metadata,
+// access counters and its share of the ANN index
+size_t VectorStore::fixedRowBytes() const {
+    size_t bytes = sizeof(std::string) + sizeof(float)
+                 + MetadataColumns::ROW_BYTES + RowAccessLog::ROW_BYTES;
+    if (layout == Layout::Dense) {
+        bytes += isQuantized() ? quantized.stride() : embeddings.stride() * sizeof(float);
+    } else {
+        bytes += sizeof(size_t);   // CSR offset
+    }
+    if (searchIndex == SearchIndex::Hnsw) bytes += hnsw.rowBytes();
+    if (searchIndex == SearchIndex::Ivf) bytes += 2 * sizeof(uint32_t);
+    if (searchIndex == SearchIndex::Binary) bytes += binary.rowBytes();
+    return bytes;
+}
+
+// CSR entries are counted twice: once in the rows, once in the postings
+static constexpr size_t SPARSE_ENTRY_BYTES = 2 * (sizeof(uint32_t) + sizeof(float));
+
+size_t VectorStore::getMemoryUsage() const {
+    size_t total = documentBytes + documents.size() * fixedRowBytes();
+    if (layout == Layout::Sparse) total += sparseEmbeddings.nnz() * SPARSE_ENTRY_BYTES;
+    return total;
+}
+
+size_t VectorStore::rowMemoryBytes(size_t row) const {
+    if (row >= documents.size()) return 0;
+    size_t total = textSize(documents[row]) + fixedRowBytes();
+    if (layout == Layout::Sparse) total += sparseEmbeddings.row(row).nnz() * SPARSE_ENTRY_BYTES;
+    return total;
+}
+
+std::vector<uint32_t> VectorStore::evictionOrder() const {
+    auto order = access.coldestFirst(evictionPolicy);
+    if (metadata.deletedRows() > 0) {
+        std::erase_if(order, [this](uint32_t row) { return metadata.isDeleted(row); });
     }
+    return order;
+}
+
+size_t VectorStore::enforceMemoryLimit(size_t maxMemoryBytes) {
+    // Tombstones hold their vectors until compacted, so they go first
+    if (getMemoryUsage() > maxMemoryBytes) compact();
+    size_t usage = getMemoryUsage();
+    if (usage <= maxMemoryBytes) return 0;
+
+    std::vector<uint32_t> victims;
+    for (uint32_t row : evictionOrder()) {
+        if (usage <= maxMemoryBytes) break;
+        usage -= std::min(usage, rowMemoryBytes(row));
+        victims.push_back(row);
+    }
+    removeRows(victims);
+    return victims.size();
+}